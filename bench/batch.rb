@@ -0,0 +1,41 @@
+##
+# Compares the per-operation overhead of calling Mouse methods one at a
+# time with performing the same operations as a Mouse.batch
+#
+# The cursor is parked first and every operation is a move to where the
+# cursor already is, which posts nothing and leaves only the overhead.
+#
+# Run after `rake compile`:
+#
+#     ruby -Ilib bench/batch.rb [operations]
+#
+require 'mouse'
+
+count = (ARGV[0] || 10_000).to_i
+point = [300, 300]
+Mouse.move_to point, 0
+
+def clock
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+def measure label, count
+  start   = clock
+  yield
+  elapsed = clock - start
+  printf("%-22s %8.2f us/op\n", label, elapsed * 1_000_000 / count)
+end
+
+measure('unbatched', count) do
+  count.times { Mouse.move_to point, 0 }
+end
+
+measure('batched', count) do
+  Mouse.batch { |b| count.times { b.move_to point, 0 } }
+end
+
+batch = Mouse::Batch.new
+count.times { batch.move_to point, 0 }
+measure('batched, prerecorded', count) do
+  batch.run
+end
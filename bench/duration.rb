@@ -0,0 +1,39 @@
+##
+# Measures how far animated mouse operations stray from the duration
+# they were asked to take
+#
+# Run after `rake compile`:
+#
+#     ruby -Ilib bench/duration.rb [iterations] [duration]
+#
+require 'mouse'
+
+iterations = (ARGV[0] || 100).to_i
+duration   = (ARGV[1] || 0.2).to_f
+points     = [CGPoint.new(200, 200), CGPoint.new(600, 400)]
+
+def clock
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+def report name, deviations
+  sorted = deviations.sort
+  mean   = sorted.inject(:+) / sorted.size
+  p99    = sorted[(0.99 * (sorted.size - 1)).ceil]
+  printf("%-8s mean %+8.3f ms   p99 %+8.3f ms\n", name, mean * 1000, p99 * 1000)
+end
+
+{
+  move_to: ->(i) { Mouse.move_to points[i % 2], duration },
+  drag_to: ->(i) { Mouse.drag_to points[i % 2], duration },
+  scroll:  ->(i) { Mouse.scroll(i.even? ? 5 : -5, :line, duration) },
+  pinch:   ->(i) { Mouse.pinch((i.even? ? :zoom : :unzoom), 1, points[0], duration) }
+}.each do |name, operation|
+  Mouse.move_to points[1], 0
+  deviations = Array.new(iterations) do |i|
+    start = clock
+    operation.call i
+    clock - start - duration
+  end
+  report name, deviations
+end
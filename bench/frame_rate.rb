@@ -0,0 +1,28 @@
+##
+# Compares the rate at which events are actually posted with the frame
+# rate that was asked for
+#
+# Run after `rake compile`:
+#
+#     ruby -Ilib bench/frame_rate.rb [duration]
+#
+require 'mouse'
+
+duration = (ARGV[0] || 1.0).to_f
+points   = [CGPoint.new(200, 200), CGPoint.new(900, 700)]
+
+def clock
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+Mouse.dead_reckoning = true
+[10, 30, 60, 120, 240, 500, 1000].each_with_index do |fps, i|
+  Mouse.move_to points[i % 2], 0
+  before = Mouse.event_counts[:posted]
+  start  = clock
+  Mouse.move_to points[(i + 1) % 2], duration, fps: fps
+  elapsed = clock - start
+  posted  = Mouse.event_counts[:posted] - before
+  printf("requested %4d fps   achieved %7.1f fps   (%d events in %.3f s)\n",
+         fps, posted / elapsed, posted, elapsed)
+end
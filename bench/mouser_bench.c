@@ -0,0 +1,626 @@
+//
+//  mouser_bench.c
+//  MRMouse
+//
+//  A micro-benchmark for the mouser core, posting to the memory backend
+//  so that it runs anywhere and never touches a real cursor. Build and run it with `rake bench`, which writes the results
+//  as JSON.
+//
+//  Most operations are timed with the clock warped, where waiting for a
+//  frame jumps the clock forward instead of sleeping; that measures the
+//  time the core spends working rather than waiting on its frame
+//  schedule.
+//
+//  When built with MOUSE_BENCH_WRAP (which needs GNU ld and
+//  -Wl,--wrap for each function below) the benchmark also counts heap
+//  allocations, and stands /dev/null in for /dev/uinput, so that the
+//  system calls made by the uinput backend can be counted without a
+//  device.
+//
+
+#include "mouser.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS      200 // per operation, on the warped clock
+#define WALL_ITERATIONS 3   // per operation, in real time
+#define JITTER_FPS      240
+#define JITTER_FRAMES   480
+#define POST_FRAMES     20000
+#define UINPUT_FPS      1000
+
+static const CGPoint ORIGIN = { 100, 100 };
+static const CGPoint TARGET = { 700, 500 };
+
+
+// Allocations
+
+#ifdef MOUSE_BENCH_WRAP
+
+static size_t allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+void*
+__wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void*
+__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void*
+__wrap_realloc(void* pointer, size_t size)
+{
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_realloc(pointer, size);
+}
+
+// Calls made on the stand in for /dev/uinput
+static int    uinput_fd     = -1;
+static size_t uinput_writes = 0;
+static size_t uinput_ioctls = 0;
+
+int     __real_open(const char* path, int flags, ...);
+int     __real_ioctl(int fd, unsigned long request, ...);
+ssize_t __real_write(int fd, const void* buffer, size_t length);
+
+int
+__wrap_open(const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list rest;
+        va_start(rest, flags);
+        mode = va_arg(rest, mode_t);
+        va_end(rest);
+    }
+    if (strcmp(path, "/dev/uinput") == 0)
+        return uinput_fd = __real_open("/dev/null", O_WRONLY);
+    return __real_open(path, flags, mode);
+}
+
+int
+__wrap_ioctl(int fd, unsigned long request, ...)
+{
+    va_list rest;
+    va_start(rest, request);
+    void* const argument = va_arg(rest, void*);
+    va_end(rest);
+
+    if (fd == uinput_fd) {
+        uinput_ioctls++;
+        return 0;
+    }
+    return __real_ioctl(fd, request, argument);
+}
+
+ssize_t
+__wrap_write(int fd, const void* buffer, size_t length)
+{
+    if (fd == uinput_fd)
+        uinput_writes++;
+    return __real_write(fd, buffer, length);
+}
+
+#endif
+
+// Time on the real clock, even while the core's clock is warped
+static
+uint64_t
+real_now(void)
+{
+    return mouse_clock_now();
+}
+
+
+// Statistics
+
+typedef struct {
+    double mean;
+    double stddev;
+    double p50;
+    double p99;
+    double max;
+} bench_stats_t;
+
+static
+int
+bench_compare(const void* const a, const void* const b)
+{
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the samples in place
+static
+bench_stats_t
+bench_stats(double* const samples, const size_t count)
+{
+    bench_stats_t stats = { 0, 0, 0, 0, 0 };
+    if (!count)
+        return stats;
+
+    double sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += samples[i];
+    stats.mean = sum / count;
+
+    double squares = 0;
+    for (size_t i = 0; i < count; i++)
+        squares += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+    stats.stddev = sqrt(squares / count);
+
+    qsort(samples, count, sizeof(double), bench_compare);
+    stats.p50 = samples[(count - 1) / 2];
+    stats.p99 = samples[(size_t)((count - 1) * 0.99)];
+    stats.max = samples[count - 1];
+    return stats;
+}
+
+static
+void
+bench_print_stats(FILE* const out, const bench_stats_t stats)
+{
+    fprintf(out,
+            "{\"mean\": %.1f, \"stddev\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}",
+            stats.mean, stats.stddev, stats.p50, stats.p99, stats.max);
+}
+
+
+// Per event cost
+
+// Posts a long animation on the warped clock, so every frame is posted
+// back to back, and divides the time taken by the number of events
+static
+void
+bench_post(FILE* const out)
+{
+#ifdef MOUSE_BENCH_WRAP
+    // the far corner has to be on the screen, or the animation would
+    // keep going until its safety break
+    const CGPoint screen = mouse_memory_screen(mouse_memory());
+    mouse_memory_set_screen(mouse_memory(), CGPointMake(ORIGIN.x + POST_FRAMES + 1, ORIGIN.y + POST_FRAMES + 1));
+
+    fprintf(out, "  \"post\": {");
+    for (int reckoning = 0; reckoning < 2; reckoning++) {
+        mouse_set_dead_reckoning(reckoning);
+        mouse_memory_set_position(mouse_memory(), ORIGIN);
+        const CGPoint far = CGPointMake(ORIGIN.x + POST_FRAMES, ORIGIN.y + POST_FRAMES);
+
+        mouse_set_time_warp(true);
+        const size_t   posted = mouse_event_counts().posted;
+        const size_t   allocs = allocations;
+        const uint64_t start  = real_now();
+        mouse_move_to3(far, POST_FRAMES / MAX_FPS, MAX_FPS);
+        const uint64_t elapsed = real_now() - start;
+        mouse_set_time_warp(false);
+
+        const size_t events = mouse_event_counts().posted - posted;
+        fprintf(out,
+                "%s\n    \"%s\": {\"events\": %zu, \"ns_per_event\": %.1f, \"allocations\": %zu}",
+                reckoning ? "," : "",
+                reckoning ? "dead_reckoning" : "closed_loop",
+                events,
+                (double)elapsed / events,
+                allocations - allocs);
+    }
+    mouse_set_dead_reckoning(false);
+    mouse_memory_set_screen(mouse_memory(), screen);
+    fprintf(out, "\n  },\n");
+#else
+    fprintf(out, "  \"post\": null,\n");
+#endif
+}
+
+
+// Frame jitter
+
+static mouse_event_t frames[JITTER_FRAMES + 1];
+
+// Times the gaps between frames of a real animation, and how late each
+// frame was posted relative to when it was due
+static
+void
+bench_jitter(FILE* const out)
+{
+    const double period = 1000000000.0 / JITTER_FPS;
+    double* const intervals = calloc(JITTER_FRAMES, sizeof(double));
+    double* const lateness  = calloc(JITTER_FRAMES, sizeof(double));
+
+    mouse_memory_set_position(mouse_memory(), ORIGIN);
+    mouse_memory_clear(mouse_memory());
+    const uint64_t start = mouse_now();
+    mouse_move_to3(CGPointMake(ORIGIN.x + JITTER_FRAMES, ORIGIN.y),
+                   JITTER_FRAMES / (double)JITTER_FPS,
+                   JITTER_FPS);
+    const size_t frames_seen = mouse_memory_events(mouse_memory(), frames, JITTER_FRAMES + 1);
+
+    size_t count = 0;
+    for (size_t i = 1; i < frames_seen; i++, count++) {
+        intervals[count] = (double)(frames[i].timestamp - frames[i - 1].timestamp);
+        // frame i + 1 is due i + 1 periods after the animation started,
+        // though the first frame is posted without waiting
+        lateness[count]  = (double)frames[i].timestamp - ((double)start + (i * period));
+    }
+
+    fprintf(out,
+            "  \"jitter\": {\n    \"fps\": %d,\n    \"frames\": %zu,\n    \"period_ns\": %.1f,\n    \"interval_ns\": ",
+            JITTER_FPS, frames_seen, period);
+    bench_print_stats(out, bench_stats(intervals, count));
+    fprintf(out, ",\n    \"lateness_ns\": ");
+    bench_print_stats(out, bench_stats(lateness, count));
+    fprintf(out, "\n  },\n");
+
+    free(intervals);
+    free(lateness);
+}
+
+
+// uinput system calls
+
+#if defined(MOUSE_BENCH_WRAP) && defined(MOUSE_UINPUT)
+
+static void bench_uinput_move(void)   { mouse_move_to3(TARGET, 0.2, UINPUT_FPS); mouse_move_to3(ORIGIN, 0.2, UINPUT_FPS); }
+static void bench_uinput_drag(void)   { mouse_drag_to3(TARGET, 0.2, UINPUT_FPS); mouse_drag_to3(ORIGIN, 0.2, UINPUT_FPS); }
+static void bench_uinput_scroll(void) { mouse_scroll4(50, kCGScrollEventUnitPixel, 0.2, UINPUT_FPS); }
+static void bench_uinput_click(void)  { mouse_click2(TARGET); }
+
+static const struct {
+    const char* name;
+    void (*run)(void);
+} uinput_operations[] = {
+    { "move_to", bench_uinput_move   },
+    { "drag_to", bench_uinput_drag   },
+    { "scroll",  bench_uinput_scroll },
+    { "click",   bench_uinput_click  }
+};
+
+#define UINPUT_OPERATIONS (sizeof(uinput_operations) / sizeof(uinput_operations[0]))
+
+static
+uint64_t
+bench_frames_posted(void)
+{
+    mouse_stats_t stats;
+    mouse_device_stats(&stats);
+    uint64_t frames = 0;
+    for (size_t i = 0; i < kMouseStatsOperations; i++)
+        frames += stats.operations[i].frames_posted;
+    return frames;
+}
+
+#endif
+
+// Runs a few operations on a uinput device at 1000 frames per second,
+// on the warped clock, and counts the system calls made per frame; every
+// frame should go out in a single write()
+static
+void
+bench_uinput(FILE* const out)
+{
+#if defined(MOUSE_BENCH_WRAP) && defined(MOUSE_UINPUT)
+    mouse_device_t* const device = mouse_device_new(mouse_backend_find("uinput"));
+    if (!device) {
+        fprintf(out, "  \"uinput\": null,\n");
+        return;
+    }
+
+    fprintf(out, "  \"uinput\": {");
+    mouse_device_t* const memory = mouse_set_device(device);
+    mouse_set_dead_reckoning(true);
+    for (size_t i = 0; i < UINPUT_OPERATIONS; i++) {
+        mouse_device_reset_stats();
+        const size_t writes = uinput_writes;
+        const size_t ioctls = uinput_ioctls;
+        const size_t posted = mouse_event_counts().posted;
+        mouse_set_time_warp(true);
+        const uint64_t start = real_now();
+        uinput_operations[i].run();
+        const uint64_t elapsed = real_now() - start;
+        mouse_set_time_warp(false);
+
+        const uint64_t frames   = bench_frames_posted();
+        const size_t   syscalls = (uinput_writes - writes) + (uinput_ioctls - ioctls);
+        fprintf(out,
+                "%s\n    \"%s\": {\"events\": %zu, \"frames\": %llu, \"syscalls\": %zu, \"syscalls_per_frame\": %.2f, \"ns_per_frame\": %.1f}",
+                i ? "," : "",
+                uinput_operations[i].name,
+                mouse_event_counts().posted - posted,
+                (unsigned long long)frames,
+                syscalls,
+                frames ? (double)syscalls / frames : 0,
+                frames ? (double)elapsed / frames : 0);
+    }
+    mouse_set_device(memory);
+    mouse_device_release(device);
+    fprintf(out, "\n  },\n");
+#else
+    fprintf(out, "  \"uinput\": null,\n");
+#endif
+}
+
+
+// Public functions
+
+static double path[] = { 100, 100, 300, 200, 500, 100, 700, 400 };
+
+static mouse_trace_record_t trace_records[64];
+static mouse_trace_t trace = { trace_records, 64, NULL, 0 };
+
+static
+void
+bench_setup_trace(void)
+{
+    for (size_t i = 0; i < 64; i++) {
+        trace_records[i].timestamp = i * 1000000; // 1ms apart
+        trace_records[i].type      = kCGEventMouseMoved;
+        trace_records[i].x         = ORIGIN.x + i;
+        trace_records[i].y         = ORIGIN.y + i;
+    }
+}
+
+#define BENCH(name, call) static void bench_##name(void) { call; }
+
+BENCH(current_position,           (void)mouse_current_position())
+BENCH(set_fps,                    mouse_set_fps(DEFAULT_FPS))
+BENCH(fps,                        (void)mouse_fps())
+BENCH(set_dead_reckoning,         mouse_set_dead_reckoning(false))
+BENCH(dead_reckoning,             (void)mouse_dead_reckoning())
+BENCH(set_profile,                mouse_set_profile(kMouseProfileLinear))
+BENCH(profile,                    (void)mouse_profile())
+BENCH(move_to,                    mouse_move_to(TARGET))
+BENCH(move_to2,                   mouse_move_to2(TARGET, DEFAULT_DURATION))
+BENCH(move_to3,                   mouse_move_to3(TARGET, DEFAULT_DURATION, DEFAULT_FPS))
+BENCH(move_to4,                   mouse_move_to4(TARGET, DEFAULT_DURATION, DEFAULT_FPS, kMouseProfileMinimumJerk))
+BENCH(follow_path2,               mouse_follow_path2(path, 4, DEFAULT_DURATION))
+BENCH(follow_path3,               mouse_follow_path3(path, 4, DEFAULT_DURATION, DEFAULT_FPS))
+BENCH(replay,                     mouse_replay(&trace))
+BENCH(drag_to,                    mouse_drag_to(TARGET))
+BENCH(drag_to2,                   mouse_drag_to2(TARGET, DEFAULT_DURATION))
+BENCH(drag_to3,                   mouse_drag_to3(TARGET, DEFAULT_DURATION, DEFAULT_FPS))
+BENCH(drag_to4,                   mouse_drag_to4(TARGET, DEFAULT_DURATION, DEFAULT_FPS, kMouseProfileSCurve))
+BENCH(scroll,                     mouse_scroll(10))
+BENCH(scroll2,                    mouse_scroll2(10, kCGScrollEventUnitPixel))
+BENCH(scroll3,                    mouse_scroll3(10, kCGScrollEventUnitLine, DEFAULT_DURATION))
+BENCH(scroll4,                    mouse_scroll4(10, kCGScrollEventUnitLine, DEFAULT_DURATION, DEFAULT_FPS))
+BENCH(horizontal_scroll,          mouse_horizontal_scroll(10))
+BENCH(horizontal_scroll2,         mouse_horizontal_scroll2(10, kCGScrollEventUnitPixel))
+BENCH(horizontal_scroll3,         mouse_horizontal_scroll3(10, kCGScrollEventUnitLine, DEFAULT_DURATION))
+BENCH(horizontal_scroll4,         mouse_horizontal_scroll4(10, kCGScrollEventUnitLine, DEFAULT_DURATION, DEFAULT_FPS))
+BENCH(click_down,                 mouse_click_down(); mouse_click_up())
+BENCH(click_down2,                mouse_click_down2(TARGET); mouse_click_up())
+BENCH(click_down3,                mouse_click_down3(TARGET, 1); mouse_click_up())
+BENCH(click_up,                   mouse_click_up())
+BENCH(click_up2,                  mouse_click_up2(TARGET))
+BENCH(click,                      mouse_click())
+BENCH(click2,                     mouse_click2(TARGET))
+BENCH(secondary_click_down,       mouse_secondary_click_down(); mouse_secondary_click_up())
+BENCH(secondary_click_down2,      mouse_secondary_click_down2(TARGET); mouse_secondary_click_up())
+BENCH(secondary_click_down3,      mouse_secondary_click_down3(TARGET, 1); mouse_secondary_click_up())
+BENCH(secondary_click_up,         mouse_secondary_click_up())
+BENCH(secondary_click_up2,        mouse_secondary_click_up2(TARGET))
+BENCH(secondary_click,            mouse_secondary_click())
+BENCH(secondary_click2,           mouse_secondary_click2(TARGET))
+BENCH(secondary_click3,           mouse_secondary_click3(TARGET, 1))
+BENCH(arbitrary_click_down,       mouse_arbitrary_click_down(kCGMouseButtonCenter); mouse_arbitrary_click_up(kCGMouseButtonCenter))
+BENCH(arbitrary_click_down2,      mouse_arbitrary_click_down2(kCGMouseButtonCenter, TARGET); mouse_arbitrary_click_up(kCGMouseButtonCenter))
+BENCH(arbitrary_click_down3,      mouse_arbitrary_click_down3(kCGMouseButtonCenter, TARGET, 1); mouse_arbitrary_click_up(kCGMouseButtonCenter))
+BENCH(arbitrary_click_up,         mouse_arbitrary_click_up(kCGMouseButtonCenter))
+BENCH(arbitrary_click_up2,        mouse_arbitrary_click_up2(kCGMouseButtonCenter, TARGET))
+BENCH(arbitrary_click,            mouse_arbitrary_click(kCGMouseButtonCenter))
+BENCH(arbitrary_click2,           mouse_arbitrary_click2(kCGMouseButtonCenter, TARGET))
+BENCH(arbitrary_click3,           mouse_arbitrary_click3(kCGMouseButtonCenter, TARGET, 1))
+BENCH(middle_click,               mouse_middle_click())
+BENCH(middle_click2,              mouse_middle_click2(TARGET))
+BENCH(multi_click,                mouse_multi_click(4))
+BENCH(multi_click2,               mouse_multi_click2(4, TARGET))
+BENCH(double_click,               mouse_double_click())
+BENCH(double_click2,              mouse_double_click2(TARGET))
+BENCH(triple_click,               mouse_triple_click())
+BENCH(triple_click2,              mouse_triple_click2(TARGET))
+BENCH(click_all,                  mouse_click_all(path, 4, kCGMouseButtonLeft, 1 / DEFAULT_FPS, 1 / DEFAULT_FPS))
+BENCH(smart_magnify,              mouse_smart_magnify())
+BENCH(smart_magnify2,             mouse_smart_magnify2(TARGET))
+BENCH(swipe,                      mouse_swipe(kCGSwipeDirectionUp))
+BENCH(swipe2,                     mouse_swipe2(kCGSwipeDirectionLeft, TARGET))
+BENCH(pinch,                      mouse_pinch(kCGPinchExpand))
+BENCH(pinch2,                     mouse_pinch2(kCGPinchExpand, 2))
+BENCH(pinch3,                     mouse_pinch3(kCGPinchContract, 2, TARGET))
+BENCH(pinch4,                     mouse_pinch4(kCGPinchContract, 2, TARGET, DEFAULT_DURATION))
+BENCH(pinch5,                     mouse_pinch5(kCGPinchContract, 2, TARGET, DEFAULT_DURATION, DEFAULT_FPS))
+BENCH(rotate,                     mouse_rotate(kCGRotateClockwise, 90))
+BENCH(rotate2,                    mouse_rotate2(kCGRotateClockwise, 90, TARGET))
+BENCH(rotate3,                    mouse_rotate3(kCGRotateCounterClockwise, 90, TARGET, DEFAULT_DURATION))
+BENCH(rotate4,                    mouse_rotate4(kCGRotateCounterClockwise, 90, TARGET, DEFAULT_DURATION, DEFAULT_FPS))
+
+#define OPERATION(name) { "mouse_" #name, bench_##name }
+
+static const struct {
+    const char* name;
+    void (*run)(void);
+} operations[] = {
+    OPERATION(current_position),
+    OPERATION(set_fps),
+    OPERATION(fps),
+    OPERATION(set_dead_reckoning),
+    OPERATION(dead_reckoning),
+    OPERATION(set_profile),
+    OPERATION(profile),
+    OPERATION(move_to),
+    OPERATION(move_to2),
+    OPERATION(move_to3),
+    OPERATION(move_to4),
+    OPERATION(follow_path2),
+    OPERATION(follow_path3),
+    OPERATION(replay),
+    OPERATION(drag_to),
+    OPERATION(drag_to2),
+    OPERATION(drag_to3),
+    OPERATION(drag_to4),
+    OPERATION(scroll),
+    OPERATION(scroll2),
+    OPERATION(scroll3),
+    OPERATION(scroll4),
+    OPERATION(horizontal_scroll),
+    OPERATION(horizontal_scroll2),
+    OPERATION(horizontal_scroll3),
+    OPERATION(horizontal_scroll4),
+    OPERATION(click_down),
+    OPERATION(click_down2),
+    OPERATION(click_down3),
+    OPERATION(click_up),
+    OPERATION(click_up2),
+    OPERATION(click),
+    OPERATION(click2),
+    OPERATION(secondary_click_down),
+    OPERATION(secondary_click_down2),
+    OPERATION(secondary_click_down3),
+    OPERATION(secondary_click_up),
+    OPERATION(secondary_click_up2),
+    OPERATION(secondary_click),
+    OPERATION(secondary_click2),
+    OPERATION(secondary_click3),
+    OPERATION(arbitrary_click_down),
+    OPERATION(arbitrary_click_down2),
+    OPERATION(arbitrary_click_down3),
+    OPERATION(arbitrary_click_up),
+    OPERATION(arbitrary_click_up2),
+    OPERATION(arbitrary_click),
+    OPERATION(arbitrary_click2),
+    OPERATION(arbitrary_click3),
+    OPERATION(middle_click),
+    OPERATION(middle_click2),
+    OPERATION(multi_click),
+    OPERATION(multi_click2),
+    OPERATION(double_click),
+    OPERATION(double_click2),
+    OPERATION(triple_click),
+    OPERATION(triple_click2),
+    OPERATION(click_all),
+    OPERATION(smart_magnify),
+    OPERATION(smart_magnify2),
+    OPERATION(swipe),
+    OPERATION(swipe2),
+    OPERATION(pinch),
+    OPERATION(pinch2),
+    OPERATION(pinch3),
+    OPERATION(pinch4),
+    OPERATION(pinch5),
+    OPERATION(rotate),
+    OPERATION(rotate2),
+    OPERATION(rotate3),
+    OPERATION(rotate4)
+};
+
+#define OPERATIONS (sizeof(operations) / sizeof(operations[0]))
+
+// Each operation starts from the same place so that moves are never no-ops
+static
+double
+bench_operation(void (* const run)(void), const size_t iterations, size_t* const events)
+{
+    const size_t   posted = mouse_event_counts().posted;
+    uint64_t       total  = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        mouse_memory_set_position(mouse_memory(), ORIGIN);
+        const uint64_t start = real_now();
+        run();
+        total += real_now() - start;
+    }
+    *events = (mouse_event_counts().posted - posted) / iterations;
+    return (double)total / iterations;
+}
+
+static
+void
+bench_operations(FILE* const out, const bool wall)
+{
+    fprintf(out, "  \"operations\": {");
+    for (size_t i = 0; i < OPERATIONS; i++) {
+        size_t events = 0;
+        fprintf(out, "%s\n    \"%s\": {", i ? "," : "", operations[i].name);
+
+        if (wall) {
+            const double wall_ns = bench_operation(operations[i].run, WALL_ITERATIONS, &events);
+            fprintf(out, "\"wall_ns\": %.1f, ", wall_ns);
+        }
+        else {
+            fprintf(out, "\"wall_ns\": null, ");
+        }
+
+#ifdef MOUSE_BENCH_WRAP
+        const size_t allocs = allocations;
+        mouse_set_time_warp(true);
+        const double busy_ns = bench_operation(operations[i].run, ITERATIONS, &events);
+        mouse_set_time_warp(false);
+        fprintf(out,
+                "\"busy_ns\": %.1f, \"events\": %zu, \"allocations\": %.1f}",
+                busy_ns,
+                events,
+                (double)(allocations - allocs) / ITERATIONS);
+#else
+        fprintf(out, "\"busy_ns\": null, \"events\": %zu, \"allocations\": null}", events);
+#endif
+    }
+    fprintf(out, "\n  }\n");
+}
+
+
+int
+main(int argc, char** argv)
+{
+    // --quick skips timing each public function in real time, which
+    // takes about half a minute
+    bool wall = true;
+    const char* path_out = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0)
+            wall = false;
+        else
+            path_out = argv[i];
+    }
+
+    FILE* const out = path_out ? fopen(path_out, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "mouser_bench: %s: %s\n", path_out, strerror(errno));
+        return 1;
+    }
+
+    bench_setup_trace();
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"fps\": %.0f,\n", mouse_fps());
+    fprintf(out, "  \"allocations_counted\": %s,\n",
+#ifdef MOUSE_BENCH_WRAP
+            "true"
+#else
+            "false"
+#endif
+            );
+    bench_post(out);
+    bench_jitter(out);
+    bench_uinput(out);
+    bench_operations(out, wall);
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
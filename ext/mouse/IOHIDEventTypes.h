@@ -25,7 +25,11 @@
 #ifndef _IOKIT_HID_IOHIDEVENTTYPES_H
 #define _IOKIT_HID_IOHIDEVENTTYPES_H /* { */
 
+#ifdef __APPLE__
 #include <IOKit/IOTypes.h>
+#else
+#include <stdint.h>
+#endif
 
 #define IOHIDEventTypeMask(type) (1<<type)
 #define IOHIDEventFieldBase(type) (type << 16)
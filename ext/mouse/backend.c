@@ -0,0 +1,75 @@
+//
+//  backend.c
+//  MRMouse
+//
+
+#include "backend.h"
+#include <string.h>
+
+static const mouse_backend_t* const backends[] = {
+#ifdef __APPLE__
+    &mouse_cg_backend,
+#endif
+#ifdef MOUSE_X11
+    &mouse_x11_backend,
+#endif
+#ifdef MOUSE_UINPUT
+    &mouse_uinput_backend,
+#endif
+    &mouse_memory_backend,
+    NULL
+};
+
+const mouse_backend_t*
+mouse_backend_find(const char* const name)
+{
+    for (const mouse_backend_t* const* backend = backends; *backend; backend++)
+        if (!strcmp((*backend)->name, name))
+            return *backend;
+    return NULL;
+}
+
+mouse_trace_record_t
+mouse_event_record(const mouse_event_t* const event)
+{
+    const mouse_trace_record_t record = {
+        .timestamp         = event->timestamp,
+        .type              = (uint16_t)event->type,
+        .button            = (uint16_t)event->button,
+        .click_state       = (uint16_t)event->click_state,
+        .scroll_units      = (uint16_t)event->scroll_units,
+        .x                 = event->point.x,
+        .y                 = event->point.y,
+        .scroll_vertical   = event->scroll_vertical,
+        .scroll_horizontal = event->scroll_horizontal,
+        .gesture_type      = event->gesture_type,
+        .gesture_phase     = event->gesture_phase,
+        .swipe_direction   = event->swipe_direction,
+        .swipe_motion      = event->swipe_motion,
+        .gesture_value     = event->gesture_value,
+        .swipe_position    = event->swipe_position
+    };
+    return record;
+}
+
+mouse_event_t
+mouse_record_event(const mouse_trace_record_t* const record)
+{
+    const mouse_event_t event = {
+        .timestamp         = record->timestamp,
+        .type              = record->type,
+        .point             = CGPointMake(record->x, record->y),
+        .button            = record->button,
+        .click_state       = record->click_state,
+        .scroll_units      = record->scroll_units,
+        .scroll_vertical   = record->scroll_vertical,
+        .scroll_horizontal = record->scroll_horizontal,
+        .gesture_type      = record->gesture_type,
+        .gesture_phase     = record->gesture_phase,
+        .swipe_direction   = record->swipe_direction,
+        .swipe_motion      = record->swipe_motion,
+        .gesture_value     = record->gesture_value,
+        .swipe_position    = record->swipe_position
+    };
+    return event;
+}
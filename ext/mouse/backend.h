@@ -0,0 +1,130 @@
+//
+//  backend.h
+//  MRMouse
+//
+//  A backend is where the events made by the core end up, and where the
+//  core asks for the position of the cursor and the time. The core builds
+//  each event as a plain struct on the stack, so a backend only has to
+//  translate it for its platform; the same animation, scroll and gesture
+//  code then runs against the window server, or against memory on
+//  machines without one. Each device opens its own instance of a
+//  backend, whose state is handed back to every operation on it.
+//
+
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "cgtypes.h"
+#include "trace.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fields that do not apply to the type of event are zero, as in a
+// mouse_trace_record_t. The timestamp is set by the core as the event is
+// posted; backends that can should pass it on, since it is the only
+// thing that keeps the timing of events when the core is not sleeping
+// on the real clock.
+typedef struct {
+    uint64_t          timestamp;         // by mouse_now()
+    CGEventType       type;              // including kCGEventGesture
+    CGPoint           point;
+    CGMouseButton     button;
+    int64_t           click_state;
+    CGScrollEventUnit scroll_units;
+    int32_t           scroll_vertical;
+    int32_t           scroll_horizontal;
+    CGGestureType     gesture_type;
+    CGGesturePhase    gesture_phase;
+    CGSwipeDirection  swipe_direction;
+    CGGestureMotion   swipe_motion;
+    double            gesture_value;     // pinch or rotation value, or swipe progress
+    double            swipe_position;    // along the axis of the swipe motion
+} mouse_event_t;
+
+// Every operation must be safe to call from any thread. `now` and
+// `sleep_until` share a clock, in nanoseconds from any starting point;
+// most backends use the system clock, mouse_clock_now().
+//
+// `open` is called for each device that uses the backend and returns the
+// state that the device passes to every other operation, or NULL if the
+// backend cannot be used; `close` gives it back. Backends with nothing
+// to keep per device leave `open` and `close` NULL, and are passed NULL.
+//
+// `flush` may also be NULL. Backends that buffer what is posted send it
+// on `flush`, which the core calls before it waits for the next frame and
+// when an operation is done, so that everything posted for one frame
+// goes out together.
+typedef struct {
+    const char* name;
+    void*    (*open)(void);
+    void     (*close)(void* const state);
+    void     (*post)(void* const state, const mouse_event_t* const event);
+    void     (*flush)(void* const state);
+    CGPoint  (*position)(void* const state);
+    uint64_t (*now)(void);
+    void     (*sleep_until)(const uint64_t deadline);
+} mouse_backend_t;
+
+#ifdef __APPLE__
+extern const mouse_backend_t mouse_cg_backend;
+#endif
+#ifdef MOUSE_X11
+extern const mouse_backend_t mouse_x11_backend;
+#endif
+#ifdef MOUSE_UINPUT
+extern const mouse_backend_t mouse_uinput_backend;
+#endif
+extern const mouse_backend_t mouse_memory_backend;
+
+// Returns NULL if no backend built into this library has that name
+const mouse_backend_t* mouse_backend_find(const char* const name);
+
+// Events and trace records hold the same fields
+mouse_trace_record_t mouse_event_record(const mouse_event_t* const event);
+mouse_event_t        mouse_record_event(const mouse_trace_record_t* const record);
+
+// The monotonic system clock, and sleeping on it
+uint64_t mouse_clock_now(void);
+void     mouse_clock_sleep_until(const uint64_t deadline);
+
+// Backends that allocate an event of their own count it here, which is
+// what mouse_event_counts() reports as created; backends that fail to
+// send events they were given count them as dropped
+void mouse_backend_created(void);
+void mouse_backend_dropped(const size_t events);
+
+
+// Each device on the memory backend posts to a virtual screen of its
+// own, 1920x1080 unless it is changed, with a cursor that starts at the
+// origin and a set of buttons held down, and keeps the most recent
+// MOUSE_MEMORY_EVENTS events in a ring. Reading the ring while events are
+// being posted may see a slot half written.
+#define MOUSE_MEMORY_EVENTS 4096 // must be a power of 2
+
+typedef struct mouse_memory mouse_memory_t;
+
+// The screen of the default device, which is never closed
+extern mouse_memory_t mouse_memory_default;
+
+// Events posted since the last clear, including those no longer in the ring
+size_t mouse_memory_count(mouse_memory_t* const memory);
+
+// Copies the last `count` events posted, or as many as are still in the
+// ring if that is fewer, oldest first; returns how many were copied
+size_t mouse_memory_events(mouse_memory_t* const memory,
+                           mouse_event_t* const events,
+                           const size_t count);
+
+// Forgets every event posted so far, and lets go of every button
+void mouse_memory_clear(mouse_memory_t* const memory);
+void mouse_memory_set_position(mouse_memory_t* const memory, const CGPoint point);
+
+// Bit `n` is set while button `n` is held down
+uint32_t mouse_memory_buttons(mouse_memory_t* const memory);
+
+// The width and height of the screen, as a point at its far corner
+CGPoint mouse_memory_screen(mouse_memory_t* const memory);
+void    mouse_memory_set_screen(mouse_memory_t* const memory, const CGPoint size);
+
+#endif
@@ -0,0 +1,175 @@
+//
+//  backend_cg.c
+//  MRMouse
+//
+//  Posts events to the window server through CoreGraphics. Each thread
+//  creates one CGEvent of each kind the first time it posts that kind of
+//  event, then changes and reposts it for every event after that, so that
+//  animations do not allocate per frame.
+//
+//  Events are stamped with the time the core gave them, rather than the
+//  time they were posted, so that events posted on a warped clock still
+//  look to the receiver as if they were spaced out in real time.
+//
+
+#ifdef __APPLE__
+
+#include "backend.h"
+#include <mach/mach_time.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct {
+    CGEventRef mouse;
+    CGEventRef gesture;
+    CGEventRef scroll[2]; // by line, by pixel
+} mouse_cg_events_t;
+
+static pthread_key_t  events_key;
+static pthread_once_t events_once = PTHREAD_ONCE_INIT;
+static mach_timebase_info_data_t timebase;
+
+static
+void
+mouse_cg_events_free(void* const context)
+{
+    mouse_cg_events_t* const events = context;
+    if (events->mouse)     CFRelease(events->mouse);
+    if (events->gesture)   CFRelease(events->gesture);
+    if (events->scroll[0]) CFRelease(events->scroll[0]);
+    if (events->scroll[1]) CFRelease(events->scroll[1]);
+    free(events);
+}
+
+static
+void
+mouse_cg_events_key_create()
+{
+    pthread_key_create(&events_key, mouse_cg_events_free);
+}
+
+static
+mouse_cg_events_t*
+mouse_cg_events()
+{
+    pthread_once(&events_once, mouse_cg_events_key_create);
+    mouse_cg_events_t* events = pthread_getspecific(events_key);
+    if (!events) {
+        events = calloc(1, sizeof(mouse_cg_events_t));
+        if (events)
+            pthread_setspecific(events_key, events);
+    }
+    return events;
+}
+
+static
+CGEventRef
+mouse_cg_created(CGEventRef const event)
+{
+    mouse_backend_created();
+    return event;
+}
+
+// A reused scroll event needs every delta field that
+// CGEventCreateScrollWheelEvent would have filled in kept in sync
+static
+void
+mouse_cg_set_scroll(CGEventRef const event, const mouse_event_t* const e)
+{
+    if (e->scroll_units == kCGScrollEventUnitPixel) {
+        CGEventSetIntegerValueField(event, kCGScrollWheelEventPointDeltaAxis1, e->scroll_vertical);
+        CGEventSetIntegerValueField(event, kCGScrollWheelEventPointDeltaAxis2, e->scroll_horizontal);
+    } else {
+        CGEventSetIntegerValueField(event, kCGScrollWheelEventDeltaAxis1, e->scroll_vertical);
+        CGEventSetIntegerValueField(event, kCGScrollWheelEventDeltaAxis2, e->scroll_horizontal);
+    }
+    CGEventSetDoubleValueField(event, kCGScrollWheelEventFixedPtDeltaAxis1, e->scroll_vertical);
+    CGEventSetDoubleValueField(event, kCGScrollWheelEventFixedPtDeltaAxis2, e->scroll_horizontal);
+}
+
+// Every gesture field is set, since the event may last have been posted
+// as a different kind of gesture
+static
+void
+mouse_cg_set_gesture(CGEventRef const event, const mouse_event_t* const e)
+{
+    const bool swipe    = e->gesture_type == kCGGestureTypeSwipe;
+    const bool vertical = e->swipe_motion == kCGGestureMotionVertical;
+
+    CGEventSetIntegerValueField(event, kCGEventGestureType,           e->gesture_type);
+    CGEventSetIntegerValueField(event, kCGEventGesturePhase,          e->gesture_phase);
+    CGEventSetIntegerValueField(event, kCGEventGestureSwipeDirection, e->swipe_direction);
+    CGEventSetIntegerValueField(event, kCGEventGestureSwipeMotion,    e->swipe_motion);
+    CGEventSetDoubleValueField( event, kCGEventGestureSwipeProgress,  swipe ? e->gesture_value : 0);
+    CGEventSetDoubleValueField( event, kCGEventGestureSwipePositionX, vertical ? 0 : e->swipe_position);
+    CGEventSetDoubleValueField( event, kCGEventGestureSwipePositionY, vertical ? e->swipe_position : 0);
+    // pinch and rotation values share a field
+    CGEventSetDoubleValueField( event, kCGEventGesturePinchValue,     swipe ? 0 : e->gesture_value);
+}
+
+static
+void
+mouse_cg_post(void* const state __attribute__ ((unused)), const mouse_event_t* const e)
+{
+    mouse_cg_events_t* const events = mouse_cg_events();
+    if (!events)
+        return;
+
+    CGEventRef event;
+    switch (e->type) {
+    case kCGEventScrollWheel: {
+        const size_t pixels = e->scroll_units == kCGScrollEventUnitPixel;
+        if (!events->scroll[pixels])
+            events->scroll[pixels] = mouse_cg_created(CGEventCreateScrollWheelEvent(nil, e->scroll_units, 2, 0, 0));
+        event = events->scroll[pixels];
+        mouse_cg_set_scroll(event, e);
+        break;
+    }
+    case kCGEventGesture:
+        if (!events->gesture) {
+            events->gesture = mouse_cg_created(CGEventCreate(nil));
+            CGEventSetType(events->gesture, kCGEventGesture);
+        }
+        event = events->gesture;
+        mouse_cg_set_gesture(event, e);
+        break;
+    default:
+        if (!events->mouse)
+            events->mouse = mouse_cg_created(CGEventCreateMouseEvent(nil, e->type, e->point, e->button));
+        event = events->mouse;
+        CGEventSetType(event, e->type);
+        CGEventSetIntegerValueField(event, kCGMouseEventButtonNumber, e->button);
+        CGEventSetIntegerValueField(event, kCGMouseEventClickState,   e->click_state);
+        break;
+    }
+
+    // event timestamps are in mach absolute time units
+    if (!timebase.numer)
+        mach_timebase_info(&timebase);
+    CGEventSetTimestamp(event, (e->timestamp * timebase.denom) / timebase.numer);
+    CGEventSetLocation(event, e->point);
+    CGEventPost(kCGHIDEventTap, event);
+}
+
+static
+CGPoint
+mouse_cg_position(void* const state __attribute__ ((unused)))
+{
+    CGEventRef const event = mouse_cg_created(CGEventCreate(nil));
+    const CGPoint point = CGEventGetLocation(event);
+    CFRelease(event);
+    return point;
+}
+
+const mouse_backend_t mouse_cg_backend = {
+    .name        = "coregraphics",
+    .open        = NULL,
+    .close       = NULL,
+    .post        = mouse_cg_post,
+    .flush       = NULL,
+    .position    = mouse_cg_position,
+    .now         = mouse_clock_now,
+    .sleep_until = mouse_clock_sleep_until
+};
+
+#endif
@@ -0,0 +1,183 @@
+//
+//  backend_memory.c
+//  MRMouse
+//
+//  Posting an event writes it into the next slot of the ring, moves the
+//  virtual cursor and presses or lets go of a button, which is all there
+//  is to the memory backend; it is meant to cost as little as possible,
+//  so that benchmarks measure the core and tests can see exactly what the
+//  core posted.
+//
+//  The cursor is kept on the virtual screen the way the window server
+//  keeps the real one on the display, so an animation towards a point
+//  off the screen never gets there, just as it would not for real.
+//
+
+#include "backend.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MASK (MOUSE_MEMORY_EVENTS - 1)
+
+struct mouse_memory {
+    mouse_event_t   ring[MOUSE_MEMORY_EVENTS];
+    size_t          posted;
+    uint32_t        buttons;
+    CGPoint         cursor;
+    CGPoint         screen;
+    pthread_mutex_t cursor_lock;
+};
+
+mouse_memory_t mouse_memory_default = {
+    .screen      = { 1920, 1080 },
+    .cursor_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static
+void*
+mouse_memory_open()
+{
+    mouse_memory_t* const memory = calloc(1, sizeof(mouse_memory_t));
+    if (!memory)
+        return NULL;
+    memory->screen = mouse_memory_default.screen;
+    pthread_mutex_init(&memory->cursor_lock, NULL);
+    return memory;
+}
+
+static
+void
+mouse_memory_close(void* const state)
+{
+    mouse_memory_t* const memory = state;
+    if (memory == &mouse_memory_default)
+        return;
+    pthread_mutex_destroy(&memory->cursor_lock);
+    free(memory);
+}
+
+static
+CGPoint
+mouse_memory_clamp(const mouse_memory_t* const memory, const CGPoint point)
+{
+    return CGPointMake(fmin(fmax(point.x, 0), memory->screen.x - 1),
+                       fmin(fmax(point.y, 0), memory->screen.y - 1));
+}
+
+static
+void
+mouse_memory_post(void* const state, const mouse_event_t* const event)
+{
+    mouse_memory_t* const memory = state;
+    const size_t slot = __atomic_fetch_add(&memory->posted, 1, __ATOMIC_ACQ_REL) & MASK;
+    memory->ring[slot] = *event;
+
+    const uint32_t button = event->button < 32 ? 1u << event->button : 0;
+    switch (event->type) {
+    case kCGEventScrollWheel:
+    case kCGEventGesture:
+        return;
+    case kCGEventLeftMouseDown:
+    case kCGEventRightMouseDown:
+    case kCGEventOtherMouseDown:
+        __atomic_fetch_or(&memory->buttons, button, __ATOMIC_RELAXED);
+        break;
+    case kCGEventLeftMouseUp:
+    case kCGEventRightMouseUp:
+    case kCGEventOtherMouseUp:
+        __atomic_fetch_and(&memory->buttons, ~button, __ATOMIC_RELAXED);
+        break;
+    default:
+        break;
+    }
+
+    pthread_mutex_lock(&memory->cursor_lock);
+    memory->cursor = mouse_memory_clamp(memory, event->point);
+    pthread_mutex_unlock(&memory->cursor_lock);
+}
+
+static
+CGPoint
+mouse_memory_position(void* const state)
+{
+    mouse_memory_t* const memory = state;
+    pthread_mutex_lock(&memory->cursor_lock);
+    const CGPoint point = memory->cursor;
+    pthread_mutex_unlock(&memory->cursor_lock);
+    return point;
+}
+
+uint32_t
+mouse_memory_buttons(mouse_memory_t* const memory)
+{
+    return __atomic_load_n(&memory->buttons, __ATOMIC_RELAXED);
+}
+
+CGPoint
+mouse_memory_screen(mouse_memory_t* const memory)
+{
+    pthread_mutex_lock(&memory->cursor_lock);
+    const CGPoint size = memory->screen;
+    pthread_mutex_unlock(&memory->cursor_lock);
+    return size;
+}
+
+void
+mouse_memory_set_screen(mouse_memory_t* const memory, const CGPoint size)
+{
+    pthread_mutex_lock(&memory->cursor_lock);
+    memory->screen = CGPointMake(fmax(size.x, 1), fmax(size.y, 1));
+    memory->cursor = mouse_memory_clamp(memory, memory->cursor);
+    pthread_mutex_unlock(&memory->cursor_lock);
+}
+
+size_t
+mouse_memory_count(mouse_memory_t* const memory)
+{
+    return __atomic_load_n(&memory->posted, __ATOMIC_ACQUIRE);
+}
+
+size_t
+mouse_memory_events(mouse_memory_t* const memory,
+                    mouse_event_t* const events,
+                    const size_t count)
+{
+    const size_t total = mouse_memory_count(memory);
+    size_t copied = count;
+    if (copied > total)
+        copied = total;
+    if (copied > MOUSE_MEMORY_EVENTS)
+        copied = MOUSE_MEMORY_EVENTS;
+
+    for (size_t i = 0; i < copied; i++)
+        events[i] = memory->ring[(total - copied + i) & MASK];
+    return copied;
+}
+
+void
+mouse_memory_clear(mouse_memory_t* const memory)
+{
+    __atomic_store_n(&memory->posted, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&memory->buttons, 0, __ATOMIC_RELAXED);
+    memset(memory->ring, 0, sizeof(memory->ring));
+}
+
+void
+mouse_memory_set_position(mouse_memory_t* const memory, const CGPoint point)
+{
+    pthread_mutex_lock(&memory->cursor_lock);
+    memory->cursor = mouse_memory_clamp(memory, point);
+    pthread_mutex_unlock(&memory->cursor_lock);
+}
+
+const mouse_backend_t mouse_memory_backend = {
+    .name        = "memory",
+    .open        = mouse_memory_open,
+    .close       = mouse_memory_close,
+    .post        = mouse_memory_post,
+    .flush       = NULL,
+    .position    = mouse_memory_position,
+    .now         = mouse_clock_now,
+    .sleep_until = mouse_clock_sleep_until
+};
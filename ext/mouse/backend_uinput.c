@@ -0,0 +1,352 @@
+//
+//  backend_uinput.c
+//  MRMouse
+//
+//  Posts events through a virtual pointer created with /dev/uinput, which
+//  the kernel hands to whatever display stack is running, or to none.
+//  Each device made on the backend gets a virtual pointer of its own.
+//  Each event becomes a packet of input events ended by a SYN_REPORT;
+//  packets are queued on the pointer and written with a single write()
+//  when the core flushes the backend, once per frame.
+//
+//  The pointer is absolute unless MOUSE_UINPUT=relative. An absolute
+//  pointer covers a screen of 1920x1080 unless MOUSE_UINPUT gives another
+//  size, like 2560x1440, and should match the real screen. Motion on a
+//  relative pointer goes through the pointer acceleration of whatever
+//  reads it, so it only lands where it was meant to with acceleration
+//  turned off.
+//
+//  The kernel has no way to say where the cursor is, so the position is
+//  where the backend last put it. Gestures are dropped, and click counts
+//  are left to the timing of the clicks, as with the X11 backend.
+//
+
+#ifdef MOUSE_UINPUT
+
+#include "backend.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define PIXELS_PER_CLICK 10
+#define QUEUE_EVENTS     256 // more than any one frame posts
+#define WRITE_TRIES      3   // times a full pointer is waited on before a packet is dropped
+#define WRITE_WAIT       2   // milliseconds
+
+// The lock covers the cursor and the queue, which the posting thread
+// and a thread asking for the position may both touch
+typedef struct {
+    int                fd;
+    bool               relative;
+    CGPoint            cursor;
+    pthread_mutex_t    lock;
+    struct input_event events[QUEUE_EVENTS];
+    size_t             count;
+    int32_t            pixels[2]; // pixel scrolls that do not yet make a click
+} mouse_uinput_t;
+
+static
+bool
+mouse_uinput_screen(bool* const relative, int* const width, int* const height)
+{
+    const char* const mode = getenv("MOUSE_UINPUT");
+    *width  = 1920;
+    *height = 1080;
+    if (!mode || !*mode)
+        return true;
+    if (!strcmp(mode, "relative")) {
+        *relative = true;
+        return true;
+    }
+    return sscanf(mode, "%dx%d", width, height) == 2 && *width > 0 && *height > 0;
+}
+
+static
+bool
+mouse_uinput_abs_setup(const int fd, const uint16_t code, const int size)
+{
+    struct uinput_abs_setup abs;
+    memset(&abs, 0, sizeof(abs));
+    abs.code               = code;
+    abs.absinfo.minimum    = 0;
+    abs.absinfo.maximum    = size - 1;
+    abs.absinfo.resolution = 1;
+    return ioctl(fd, UI_ABS_SETUP, &abs) == 0;
+}
+
+static
+bool
+mouse_uinput_setup(const mouse_uinput_t* const device, const int width, const int height)
+{
+    const int fd = device->fd;
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor  = 0x6d72; // "mr"
+    setup.id.product = device->relative ? 1 : 2;
+    snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "mouse gem virtual pointer");
+
+    bool ok = ioctl(fd, UI_SET_EVBIT, EV_KEY) == 0
+           && ioctl(fd, UI_SET_EVBIT, EV_REL) == 0
+           && ioctl(fd, UI_SET_EVBIT, EV_SYN) == 0
+           && ioctl(fd, UI_SET_RELBIT, REL_WHEEL)  == 0
+           && ioctl(fd, UI_SET_RELBIT, REL_HWHEEL) == 0;
+    for (int button = BTN_LEFT; ok && button <= BTN_TASK; button++)
+        ok = ioctl(fd, UI_SET_KEYBIT, button) == 0;
+
+    if (device->relative)
+        ok = ok
+          && ioctl(fd, UI_SET_RELBIT, REL_X) == 0
+          && ioctl(fd, UI_SET_RELBIT, REL_Y) == 0;
+    else
+        ok = ok
+          && ioctl(fd, UI_SET_EVBIT, EV_ABS) == 0
+          && ioctl(fd, UI_SET_ABSBIT, ABS_X) == 0
+          && ioctl(fd, UI_SET_ABSBIT, ABS_Y) == 0
+          && ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_POINTER) == 0
+          && mouse_uinput_abs_setup(fd, ABS_X, width)
+          && mouse_uinput_abs_setup(fd, ABS_Y, height);
+
+    return ok
+        && ioctl(fd, UI_DEV_SETUP, &setup) == 0
+        && ioctl(fd, UI_DEV_CREATE) == 0;
+}
+
+static
+void*
+mouse_uinput_open()
+{
+    mouse_uinput_t* const device = calloc(1, sizeof(mouse_uinput_t));
+    if (!device)
+        return NULL;
+
+    int width, height;
+    if (!mouse_uinput_screen(&device->relative, &width, &height)) {
+        free(device);
+        return NULL;
+    }
+
+    device->fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (device->fd < 0) {
+        free(device);
+        return NULL;
+    }
+    if (!mouse_uinput_setup(device, width, height)) {
+        close(device->fd);
+        free(device);
+        return NULL;
+    }
+    pthread_mutex_init(&device->lock, NULL);
+    return device;
+}
+
+static
+void
+mouse_uinput_close(void* const state)
+{
+    mouse_uinput_t* const device = state;
+    ioctl(device->fd, UI_DEV_DESTROY);
+    close(device->fd);
+    pthread_mutex_destroy(&device->lock);
+    free(device);
+}
+
+// Each event posted ends its packet with a SYN_REPORT
+static
+size_t
+mouse_uinput_packets(const struct input_event* const events, const size_t count)
+{
+    size_t packets = 0;
+    for (size_t i = 0; i < count; i++)
+        if (events[i].type == EV_SYN && events[i].code == SYN_REPORT)
+            packets++;
+    return packets;
+}
+
+// Called with the lock held. What a short write leaves is written again;
+// a pointer that will not take any more for a few tries, or that has gone
+// away, has the rest of the queue counted as dropped instead of blocking
+// the frame.
+static
+void
+mouse_uinput_write(mouse_uinput_t* const device)
+{
+    if (!device->count)
+        return;
+
+    const char* const buffer = (const char*)device->events;
+    const size_t length = device->count * sizeof(struct input_event);
+    size_t done = 0;
+    for (int tries = 0; done < length && tries < WRITE_TRIES;) {
+        const ssize_t written = write(device->fd, buffer + done, length - done);
+        if (written > 0)
+            done += (size_t)written;
+        else if (written < 0 && errno == EINTR)
+            continue;
+        else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd ready = { .fd = device->fd, .events = POLLOUT };
+            poll(&ready, 1, WRITE_WAIT);
+            tries++;
+        }
+        else
+            break;
+    }
+
+    if (done < length) {
+        const size_t first = done / sizeof(struct input_event);
+        mouse_backend_dropped(mouse_uinput_packets(device->events + first,
+                                                   device->count - first));
+    }
+    device->count = 0;
+}
+
+static
+void
+mouse_uinput_flush(void* const state)
+{
+    mouse_uinput_t* const device = state;
+    pthread_mutex_lock(&device->lock);
+    mouse_uinput_write(device);
+    pthread_mutex_unlock(&device->lock);
+}
+
+// The kernel fills in the time of each event as it is written
+static
+void
+mouse_uinput_queue(mouse_uinput_t* const device,
+                   const uint16_t type, const uint16_t code, const int32_t value)
+{
+    if (device->count == QUEUE_EVENTS)
+        mouse_uinput_write(device);
+
+    struct input_event* const event = &device->events[device->count++];
+    memset(event, 0, sizeof(*event));
+    event->type  = type;
+    event->code  = code;
+    event->value = value;
+}
+
+static
+void
+mouse_uinput_move(mouse_uinput_t* const device, const CGPoint point)
+{
+    const long x  = lround(point.x);
+    const long y  = lround(point.y);
+    const long dx = x - lround(device->cursor.x);
+    const long dy = y - lround(device->cursor.y);
+    device->cursor = point;
+
+    if (!device->relative) {
+        mouse_uinput_queue(device, EV_ABS, ABS_X, (int32_t)x);
+        mouse_uinput_queue(device, EV_ABS, ABS_Y, (int32_t)y);
+    }
+    else {
+        if (dx) mouse_uinput_queue(device, EV_REL, REL_X, (int32_t)dx);
+        if (dy) mouse_uinput_queue(device, EV_REL, REL_Y, (int32_t)dy);
+    }
+}
+
+static
+int32_t
+mouse_uinput_scroll_clicks(mouse_uinput_t* const device,
+                           const mouse_event_t* const event,
+                           const size_t axis,
+                           const int32_t delta)
+{
+    if (event->scroll_units != kCGScrollEventUnitPixel)
+        return delta;
+
+    device->pixels[axis] += delta;
+    const int32_t clicks = device->pixels[axis] / PIXELS_PER_CLICK;
+    device->pixels[axis] -= clicks * PIXELS_PER_CLICK;
+    return clicks;
+}
+
+// Buttons past the eighth have no code of their own
+static
+void
+mouse_uinput_button(mouse_uinput_t* const device,
+                    const mouse_event_t* const event,
+                    const int32_t pressed)
+{
+    if (event->button <= BTN_TASK - BTN_MOUSE)
+        mouse_uinput_queue(device, EV_KEY, (uint16_t)(BTN_MOUSE + event->button), pressed);
+}
+
+// Called with the lock held; returns false if nothing was queued
+static
+bool
+mouse_uinput_packet(mouse_uinput_t* const device, const mouse_event_t* const event)
+{
+    switch (event->type) {
+    case kCGEventScrollWheel: {
+        const int32_t vertical   = mouse_uinput_scroll_clicks(device, event, 0, event->scroll_vertical);
+        const int32_t horizontal = mouse_uinput_scroll_clicks(device, event, 1, event->scroll_horizontal);
+        if (!vertical && !horizontal)
+            return false;
+        // positive wheel values scroll up and right, CoreGraphics scrolls up and left
+        if (vertical)   mouse_uinput_queue(device, EV_REL, REL_WHEEL,  vertical);
+        if (horizontal) mouse_uinput_queue(device, EV_REL, REL_HWHEEL, -horizontal);
+        return true;
+    }
+    case kCGEventGesture:
+        return false;
+    case kCGEventLeftMouseDown:
+    case kCGEventRightMouseDown:
+    case kCGEventOtherMouseDown:
+        mouse_uinput_move(device, event->point);
+        mouse_uinput_button(device, event, 1);
+        return true;
+    case kCGEventLeftMouseUp:
+    case kCGEventRightMouseUp:
+    case kCGEventOtherMouseUp:
+        mouse_uinput_move(device, event->point);
+        mouse_uinput_button(device, event, 0);
+        return true;
+    default:
+        mouse_uinput_move(device, event->point);
+        return true;
+    }
+}
+
+static
+void
+mouse_uinput_post(void* const state, const mouse_event_t* const event)
+{
+    mouse_uinput_t* const device = state;
+    pthread_mutex_lock(&device->lock);
+    if (mouse_uinput_packet(device, event))
+        mouse_uinput_queue(device, EV_SYN, SYN_REPORT, 0);
+    pthread_mutex_unlock(&device->lock);
+}
+
+static
+CGPoint
+mouse_uinput_position(void* const state)
+{
+    mouse_uinput_t* const device = state;
+    pthread_mutex_lock(&device->lock);
+    const CGPoint point = device->cursor;
+    pthread_mutex_unlock(&device->lock);
+    return point;
+}
+
+const mouse_backend_t mouse_uinput_backend = {
+    .name        = "uinput",
+    .open        = mouse_uinput_open,
+    .close       = mouse_uinput_close,
+    .post        = mouse_uinput_post,
+    .flush       = mouse_uinput_flush,
+    .position    = mouse_uinput_position,
+    .now         = mouse_clock_now,
+    .sleep_until = mouse_clock_sleep_until
+};
+
+#endif
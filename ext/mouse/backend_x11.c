@@ -0,0 +1,198 @@
+//
+//  backend_x11.c
+//  MRMouse
+//
+//  Posts events to the X server named by DISPLAY, such as an Xvfb, through
+//  the XTest extension, over a connection of its own for each device.
+//  Requests are only buffered as they are posted and go out with one
+//  flush per frame, when the core flushes the backend.
+//
+//  X has no events for gestures, so they are dropped; and it works out
+//  click counts from the timing of clicks, so a click state is only as
+//  good as how quickly the clicks before it were posted.
+//
+
+#ifdef MOUSE_X11
+
+#include "backend.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+// X scrolls by clicks of the wheel, one button press and release each
+#define PIXELS_PER_CLICK 10
+
+#define BUTTON_SCROLL_UP    4
+#define BUTTON_SCROLL_DOWN  5
+#define BUTTON_SCROLL_LEFT  6
+#define BUTTON_SCROLL_RIGHT 7
+
+typedef struct {
+    Display*        display;
+    Window          root;
+    pthread_mutex_t lock;
+    int32_t         pixels[2]; // pixel scrolls that do not yet make a click
+} mouse_x11_t;
+
+static
+void*
+mouse_x11_open()
+{
+    int event_base, error_base, major, minor;
+
+    mouse_x11_t* const x11 = calloc(1, sizeof(mouse_x11_t));
+    if (!x11)
+        return NULL;
+    x11->display = XOpenDisplay(NULL);
+    if (!x11->display) {
+        free(x11);
+        return NULL;
+    }
+    if (!XTestQueryExtension(x11->display, &event_base, &error_base, &major, &minor)) {
+        XCloseDisplay(x11->display);
+        free(x11);
+        return NULL;
+    }
+    x11->root = DefaultRootWindow(x11->display);
+    pthread_mutex_init(&x11->lock, NULL);
+    return x11;
+}
+
+static
+void
+mouse_x11_close(void* const state)
+{
+    mouse_x11_t* const x11 = state;
+    XCloseDisplay(x11->display);
+    pthread_mutex_destroy(&x11->lock);
+    free(x11);
+}
+
+// CoreGraphics numbers buttons from 0 and X from 1, with the middle
+// button second; X keeps 4 to 7 for the scroll wheels
+static
+unsigned int
+mouse_x11_button(const CGMouseButton button)
+{
+    switch (button) {
+    case kCGMouseButtonLeft:   return 1;
+    case kCGMouseButtonRight:  return 3;
+    case kCGMouseButtonCenter: return 2;
+    default:                   return button + 5;
+    }
+}
+
+static
+void
+mouse_x11_clicks(Display* const display, const unsigned int button, int32_t clicks)
+{
+    for (; clicks > 0; clicks--) {
+        XTestFakeButtonEvent(display, button, True,  CurrentTime);
+        XTestFakeButtonEvent(display, button, False, CurrentTime);
+    }
+}
+
+static
+int32_t
+mouse_x11_scroll_clicks(mouse_x11_t* const x11,
+                        const mouse_event_t* const event,
+                        const size_t axis,
+                        const int32_t delta)
+{
+    if (event->scroll_units != kCGScrollEventUnitPixel)
+        return delta;
+
+    x11->pixels[axis] += delta;
+    const int32_t clicks = x11->pixels[axis] / PIXELS_PER_CLICK;
+    x11->pixels[axis] -= clicks * PIXELS_PER_CLICK;
+    return clicks;
+}
+
+static
+void
+mouse_x11_scroll(mouse_x11_t* const x11, const mouse_event_t* const event)
+{
+    const int32_t vertical   = mouse_x11_scroll_clicks(x11, event, 0, event->scroll_vertical);
+    const int32_t horizontal = mouse_x11_scroll_clicks(x11, event, 1, event->scroll_horizontal);
+
+    // positive deltas scroll up and left, as they do for CoreGraphics
+    mouse_x11_clicks(x11->display, vertical > 0 ? BUTTON_SCROLL_UP : BUTTON_SCROLL_DOWN, abs(vertical));
+    mouse_x11_clicks(x11->display, horizontal > 0 ? BUTTON_SCROLL_LEFT : BUTTON_SCROLL_RIGHT, abs(horizontal));
+}
+
+static
+void
+mouse_x11_post(void* const state, const mouse_event_t* const event)
+{
+    mouse_x11_t* const x11     = state;
+    Display* const     display = x11->display;
+    const int x = (int)lround(event->point.x);
+    const int y = (int)lround(event->point.y);
+
+    pthread_mutex_lock(&x11->lock);
+    switch (event->type) {
+    case kCGEventScrollWheel:
+        mouse_x11_scroll(x11, event);
+        break;
+    case kCGEventGesture:
+        break;
+    case kCGEventLeftMouseDown:
+    case kCGEventRightMouseDown:
+    case kCGEventOtherMouseDown:
+        XTestFakeMotionEvent(display, -1, x, y, CurrentTime);
+        XTestFakeButtonEvent(display, mouse_x11_button(event->button), True, CurrentTime);
+        break;
+    case kCGEventLeftMouseUp:
+    case kCGEventRightMouseUp:
+    case kCGEventOtherMouseUp:
+        XTestFakeMotionEvent(display, -1, x, y, CurrentTime);
+        XTestFakeButtonEvent(display, mouse_x11_button(event->button), False, CurrentTime);
+        break;
+    default:
+        XTestFakeMotionEvent(display, -1, x, y, CurrentTime);
+        break;
+    }
+    pthread_mutex_unlock(&x11->lock);
+}
+
+static
+void
+mouse_x11_flush(void* const state)
+{
+    mouse_x11_t* const x11 = state;
+    pthread_mutex_lock(&x11->lock);
+    XFlush(x11->display);
+    pthread_mutex_unlock(&x11->lock);
+}
+
+// Querying the pointer is a round trip, which also sends anything posted
+// since the last flush
+static
+CGPoint
+mouse_x11_position(void* const state)
+{
+    mouse_x11_t* const x11 = state;
+    Window root_return, child_return;
+    int    x = 0, y = 0, window_x, window_y;
+    unsigned int mask;
+
+    pthread_mutex_lock(&x11->lock);
+    XQueryPointer(x11->display, x11->root, &root_return, &child_return,
+                  &x, &y, &window_x, &window_y, &mask);
+    pthread_mutex_unlock(&x11->lock);
+    return CGPointMake(x, y);
+}
+
+const mouse_backend_t mouse_x11_backend = {
+    .name        = "x11",
+    .open        = mouse_x11_open,
+    .close       = mouse_x11_close,
+    .post        = mouse_x11_post,
+    .flush       = mouse_x11_flush,
+    .position    = mouse_x11_position,
+    .now         = mouse_clock_now,
+    .sleep_until = mouse_clock_sleep_until
+};
+
+#endif
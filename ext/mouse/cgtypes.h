@@ -0,0 +1,78 @@
+//
+//  cgtypes.h
+//  MRMouse
+//
+//  The CoreGraphics types and constants that the core is written in terms
+//  of. On OS X they come from CoreGraphics itself; everywhere else just
+//  enough of them is defined here for the core to build against one of
+//  the other backends, see backend.h. No CoreGraphics functions are
+//  declared, only the CoreGraphics backend calls those.
+//
+
+#ifndef CGTYPES_H
+#define CGTYPES_H
+
+#ifdef __APPLE__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+#else
+
+#include <stdint.h>
+#include <math.h>
+
+// Pretend to be an older SDK so CGEventAdditions.h defines gesture phases
+#define MAC_OS_X_VERSION_10_9        1090
+#define MAC_OS_X_VERSION_MAX_ALLOWED 1080
+
+typedef double CGFloat;
+
+typedef struct {
+    CGFloat x;
+    CGFloat y;
+} CGPoint;
+
+static inline
+CGPoint
+CGPointMake(const CGFloat x, const CGFloat y)
+{
+    const CGPoint point = { x, y };
+    return point;
+}
+
+typedef uint32_t CGEventType;
+enum {
+    kCGEventNull              = 0,
+    kCGEventLeftMouseDown     = 1,
+    kCGEventLeftMouseUp       = 2,
+    kCGEventRightMouseDown    = 3,
+    kCGEventRightMouseUp      = 4,
+    kCGEventMouseMoved        = 5,
+    kCGEventLeftMouseDragged  = 6,
+    kCGEventRightMouseDragged = 7,
+    kCGEventScrollWheel       = 22,
+    kCGEventOtherMouseDown    = 25,
+    kCGEventOtherMouseUp      = 26,
+    kCGEventOtherMouseDragged = 27
+};
+
+typedef uint32_t CGMouseButton;
+enum {
+    kCGMouseButtonLeft   = 0,
+    kCGMouseButtonRight  = 1,
+    kCGMouseButtonCenter = 2
+};
+
+typedef uint32_t CGEventMouseSubtype;
+
+typedef uint32_t CGScrollEventUnit;
+enum {
+    kCGScrollEventUnitPixel = 0,
+    kCGScrollEventUnitLine  = 1
+};
+
+#endif
+
+#include "CGEventAdditions.h"
+
+#endif
@@ -0,0 +1,208 @@
+//
+//  command.c
+//  MRMouse
+//
+
+#include "command.h"
+#include <math.h>
+
+// Whether the token was stopped for a reason other than its deadline
+static
+bool
+mouse_cancelled(const mouse_token_t* const token)
+{
+    return mouse_token_cancelled(token) ||
+        (token->parent && mouse_token_cancelled(token->parent));
+}
+
+void
+mouse_perform(const mouse_command_t* const command, mouse_token_t* const token)
+{
+    mouse_token_t  local_token = { .cancelled = false };
+    mouse_token_t* const run_token = token ? token : &local_token;
+    run_token->parent    = command->cancel;
+    run_token->progress  = 0;
+    run_token->timed_out = false;
+    run_token->deadline  = 0;
+    if (command->timeout > 0)
+        mouse_token_set_timeout(run_token, command->timeout);
+
+    mouse_token_t* const previous_token = mouse_set_token(run_token);
+    const bool   here = !command->has_point;
+    const CGPoint point = command->point;
+
+    switch (command->type) {
+    case kMouseCommandMoveTo:
+        mouse_move_to4(point, command->duration, command->fps, command->profile);
+        break;
+    case kMouseCommandDragTo:
+        mouse_drag_to4(point, command->duration, command->fps, command->profile);
+        break;
+    case kMouseCommandFollowPath:
+        mouse_follow_path3(command->path, command->points, command->duration, command->fps);
+        break;
+    case kMouseCommandReplay:
+        mouse_replay(command->trace);
+        break;
+    case kMouseCommandScroll:
+        mouse_scroll4(command->amount, command->units, command->duration, command->fps);
+        break;
+    case kMouseCommandHorizontalScroll:
+        mouse_horizontal_scroll4(command->amount, command->units, command->duration, command->fps);
+        break;
+    case kMouseCommandClickDown:
+        here ? mouse_click_down() : mouse_click_down2(point);
+        break;
+    case kMouseCommandClickUp:
+        here ? mouse_click_up() : mouse_click_up2(point);
+        break;
+    case kMouseCommandClick:
+        here ? mouse_click() : mouse_click2(point);
+        break;
+    case kMouseCommandSecondaryClickDown:
+        here ? mouse_secondary_click_down() : mouse_secondary_click_down2(point);
+        break;
+    case kMouseCommandSecondaryClickUp:
+        here ? mouse_secondary_click_up() : mouse_secondary_click_up2(point);
+        break;
+    case kMouseCommandSecondaryClick:
+        here ? mouse_secondary_click() : mouse_secondary_click2(point);
+        break;
+    case kMouseCommandArbitraryClickDown:
+        here ?
+            mouse_arbitrary_click_down(command->button) :
+            mouse_arbitrary_click_down2(command->button, point);
+        break;
+    case kMouseCommandArbitraryClickUp:
+        here ?
+            mouse_arbitrary_click_up(command->button) :
+            mouse_arbitrary_click_up2(command->button, point);
+        break;
+    case kMouseCommandArbitraryClick:
+        here ?
+            mouse_arbitrary_click(command->button) :
+            mouse_arbitrary_click2(command->button, point);
+        break;
+    case kMouseCommandMiddleClick:
+        here ? mouse_middle_click() : mouse_middle_click2(point);
+        break;
+    case kMouseCommandMultiClick:
+        here ?
+            mouse_multi_click(command->clicks) :
+            mouse_multi_click2(command->clicks, point);
+        break;
+    case kMouseCommandDoubleClick:
+        here ? mouse_double_click() : mouse_double_click2(point);
+        break;
+    case kMouseCommandTripleClick:
+        here ? mouse_triple_click() : mouse_triple_click2(point);
+        break;
+    case kMouseCommandClickAll:
+        mouse_click_all(command->path,
+                        command->points,
+                        command->button,
+                        command->hold,
+                        command->interval);
+        break;
+    case kMouseCommandSmartMagnify:
+        here ? mouse_smart_magnify() : mouse_smart_magnify2(point);
+        break;
+    case kMouseCommandSwipe:
+        here ?
+            mouse_swipe(command->direction) :
+            mouse_swipe2(command->direction, point);
+        break;
+    case kMouseCommandPinch:
+        mouse_pinch5(command->direction,
+                     command->magnitude,
+                     here ? mouse_current_position() : point,
+                     command->duration,
+                     command->fps);
+        break;
+    case kMouseCommandRotate:
+        mouse_rotate4(command->direction,
+                      command->magnitude,
+                      here ? mouse_current_position() : point,
+                      command->duration,
+                      command->fps);
+        break;
+    }
+
+    if (!run_token->timed_out && !mouse_cancelled(run_token))
+        run_token->progress = 1;
+
+    mouse_set_token(previous_token);
+}
+
+// Holds are a whole number of frames at the global frame rate
+static
+double
+mouse_hold_time(const double seconds)
+{
+    return ceil(mouse_fps() * seconds) / mouse_fps();
+}
+
+static
+double
+mouse_animation_time(const mouse_command_t* const command)
+{
+    return fmax(1, round(command->duration * command->fps)) / command->fps;
+}
+
+double
+mouse_command_wall_time(const mouse_command_t* const command)
+{
+    switch (command->type) {
+    case kMouseCommandMoveTo:
+    case kMouseCommandDragTo:
+    case kMouseCommandFollowPath:
+        return mouse_animation_time(command);
+    case kMouseCommandScroll:
+    case kMouseCommandHorizontalScroll:
+        return round(command->duration * command->fps) / command->fps;
+    case kMouseCommandClickDown:
+    case kMouseCommandClick:
+    case kMouseCommandSecondaryClickDown:
+    case kMouseCommandSecondaryClick:
+    case kMouseCommandArbitraryClickDown:
+    case kMouseCommandArbitraryClick:
+    case kMouseCommandMiddleClick:
+    case kMouseCommandSwipe:
+        return mouse_hold_time(HOLD);
+    case kMouseCommandSmartMagnify:
+        return mouse_hold_time(MAGNIFY_HOLD);
+    case kMouseCommandPinch:
+    case kMouseCommandRotate:
+        return mouse_animation_time(command) + mouse_hold_time(HOLD);
+    case kMouseCommandClickAll:
+        return command->points ?
+            ((command->points - 1) * (command->hold + command->interval)) + command->hold :
+            0;
+    case kMouseCommandReplay:
+        return command->trace->count ?
+            (double)(command->trace->records[command->trace->count - 1].timestamp -
+                     command->trace->records[0].timestamp) / 1000000000 :
+            0;
+    case kMouseCommandClickUp:
+    case kMouseCommandSecondaryClickUp:
+    case kMouseCommandArbitraryClickUp:
+    case kMouseCommandMultiClick:
+    case kMouseCommandDoubleClick:
+    case kMouseCommandTripleClick:
+        break;
+    }
+    return 0;
+}
+
+size_t
+mouse_perform_list(const mouse_command_t* const commands,
+                   const size_t count,
+                   mouse_token_t* const token)
+{
+    for (size_t i = 0; i < count; i++) {
+        mouse_perform(&commands[i], token);
+        if (token->progress < 1 && (token->timed_out || mouse_cancelled(token)))
+            return i;
+    }
+    return count;
+}
@@ -0,0 +1,80 @@
+//
+//  command.h
+//  MRMouse
+//
+//  A command describes a single call into mouser.h, so that the call can
+//  be recorded, queued or performed later, possibly on another thread.
+//
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "mouser.h"
+
+typedef enum {
+    kMouseCommandMoveTo,
+    kMouseCommandDragTo,
+    kMouseCommandFollowPath,
+    kMouseCommandReplay,
+    kMouseCommandScroll,
+    kMouseCommandHorizontalScroll,
+    kMouseCommandClickDown,
+    kMouseCommandClickUp,
+    kMouseCommandClick,
+    kMouseCommandSecondaryClickDown,
+    kMouseCommandSecondaryClickUp,
+    kMouseCommandSecondaryClick,
+    kMouseCommandArbitraryClickDown,
+    kMouseCommandArbitraryClickUp,
+    kMouseCommandArbitraryClick,
+    kMouseCommandMiddleClick,
+    kMouseCommandMultiClick,
+    kMouseCommandDoubleClick,
+    kMouseCommandTripleClick,
+    kMouseCommandClickAll,
+    kMouseCommandSmartMagnify,
+    kMouseCommandSwipe,
+    kMouseCommandPinch,
+    kMouseCommandRotate,
+} mouse_command_type_t;
+
+typedef struct {
+    mouse_command_type_t type;
+    bool              has_point; // otherwise, wherever the cursor is when performed
+    CGPoint               point;
+    double             duration; // seconds
+    double                  fps;
+    mouse_profile_t     profile; // for moves and drags
+    double            magnitude; // pinch magnification or rotation angle
+    int                  amount; // scroll amount
+    CGScrollEventUnit     units;
+    CGEventMouseSubtype  button;
+    size_t               clicks;
+    uint16_t          direction; // CGSwipeDirection, CGPinchDirection or CGRotateDirection
+    const void*            path; // see mouse_follow_path3(), must outlive the command
+    size_t               points;
+    double                 hold; // seconds, for each click of mouse_click_all()
+    double             interval; // seconds
+    const mouse_trace_t*  trace; // must outlive the command
+    double              timeout; // seconds, or 0 to take as long as it takes
+    const mouse_token_t* cancel; // the command also stops if this is cancelled, may be NULL
+    mouse_device_t*      device; // dispatched commands run on this, NULL for the caller's one
+} mouse_command_t;
+
+// Performs `command` with `token` installed on the calling thread, which
+// may be NULL if the command will never need to be cancelled or report
+// its progress. The command's timeout starts counting down from here.
+void mouse_perform(const mouse_command_t* const command, mouse_token_t* const token);
+
+// How long performing `command` should take, in seconds, if it is not
+// stopped early and the cursor is not already where it is going
+double mouse_command_wall_time(const mouse_command_t* const command);
+
+// Performs each of the commands in turn with the same `token`, which must
+// not be NULL, stopping at the first command that is stopped early; returns
+// how many commands finished, so `token` describes the command after those
+size_t mouse_perform_list(const mouse_command_t* const commands,
+                          const size_t count,
+                          mouse_token_t* const token);
+
+#endif
@@ -0,0 +1,454 @@
+//
+//  dispatch.c
+//  MRMouse
+//
+//  Every device gets one posting thread, started the first time a job is
+//  queued for the device, and a queue of jobs for it. The queue is an
+//  intrusive multi-producer single-consumer list, after Dmitry Vyukov's:
+//  a producer swaps its job in as the new tail and then links the old
+//  tail to it, so queueing a job is one atomic exchange and one store,
+//  and producers never wait on each other or on the posting thread.
+//
+//  Locks are only taken to sleep: by the posting thread when its queue is
+//  empty, and by callers waiting for a job to finish; producers only take
+//  one to wake the posting thread if it was asleep.
+//
+
+#include "dispatch.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct mouse_node {
+    struct mouse_node* next;
+} mouse_node_t;
+
+// The node comes first, so that a node popped off the queue is its job,
+// and the commands last, since the job is allocated with room for them
+struct mouse_job {
+    mouse_node_t                node;
+    mouse_device_t*           device;
+    size_t                     count;
+    size_t                  finished;
+    mouse_token_t              token;
+    CGPoint                 position;
+    bool                  positioned; // false if cancelled before it started
+    double                  progress;
+    mouse_job_state_t          state;
+    uint_t                references;
+    mouse_command_t       commands[];
+};
+
+typedef struct {
+    mouse_node_t*   head;     // only touched by the posting thread
+    mouse_node_t*   tail;
+    mouse_node_t    stub;
+    bool            sleeping;
+    bool            stopping; // the device is gone, exit once the queue is empty
+    uint64_t        generation;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+} mouse_dispatcher_t;
+
+// Callers waiting on jobs all wait on the one condition, since they rarely
+// wait on more than a handful of jobs at once
+static pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  finished  = PTHREAD_COND_INITIALIZER;
+static size_t   waiters    = 0;
+static uint64_t interrupts = 0;
+
+// Posting threads do not survive a fork, so dispatchers from before the
+// fork start a new one the next time a job is queued in the child
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t        generation = 0;
+
+static
+void
+mouse_dispatcher_push(mouse_dispatcher_t* const dispatcher, mouse_node_t* const node)
+{
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    mouse_node_t* const previous = __atomic_exchange_n(&dispatcher->tail, node, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&previous->next, node, __ATOMIC_RELEASE);
+}
+
+// Returns NULL if the queue is empty, and also while a job is half way
+// through being queued, in which case `busy` is set
+static
+mouse_node_t*
+mouse_dispatcher_pop(mouse_dispatcher_t* const dispatcher, bool* const busy)
+{
+    mouse_node_t* head = dispatcher->head;
+    mouse_node_t* next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    *busy = false;
+
+    if (head == &dispatcher->stub) {
+        if (!next) {
+            *busy = __atomic_load_n(&dispatcher->tail, __ATOMIC_SEQ_CST) != head;
+            return NULL;
+        }
+        dispatcher->head = next;
+        head = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next) {
+        dispatcher->head = next;
+        return head;
+    }
+
+    if (__atomic_load_n(&dispatcher->tail, __ATOMIC_SEQ_CST) != head) {
+        *busy = true;
+        return NULL;
+    }
+
+    // the last job can only be taken once there is another node behind it
+    mouse_dispatcher_push(dispatcher, &dispatcher->stub);
+    next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        dispatcher->head = next;
+        return head;
+    }
+    *busy = true;
+    return NULL;
+}
+
+static
+bool
+mouse_dispatcher_empty(mouse_dispatcher_t* const dispatcher)
+{
+    const mouse_node_t* const head = dispatcher->head;
+    return head == &dispatcher->stub &&
+        !__atomic_load_n(&head->next, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&dispatcher->tail, __ATOMIC_SEQ_CST) == head;
+}
+
+static
+void
+mouse_dispatcher_wake(mouse_dispatcher_t* const dispatcher)
+{
+    if (!__atomic_load_n(&dispatcher->sleeping, __ATOMIC_SEQ_CST))
+        return;
+    pthread_mutex_lock(&dispatcher->lock);
+    pthread_cond_signal(&dispatcher->wake);
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+// Sleeps until something is queued; the flag is set before the queue is
+// looked at one last time, so a producer either sees the flag or its job
+// is seen here. Returns false once the dispatcher is stopping and has
+// nothing left to post, which is only decided under the lock, so that
+// mouse_dispatcher_stop() is done with the dispatcher before it is freed.
+static
+bool
+mouse_dispatcher_sleep(mouse_dispatcher_t* const dispatcher)
+{
+    pthread_mutex_lock(&dispatcher->lock);
+    __atomic_store_n(&dispatcher->sleeping, true, __ATOMIC_SEQ_CST);
+    bool empty;
+    while ((empty = mouse_dispatcher_empty(dispatcher)) && !dispatcher->stopping)
+        pthread_cond_wait(&dispatcher->wake, &dispatcher->lock);
+    __atomic_store_n(&dispatcher->sleeping, false, __ATOMIC_SEQ_CST);
+    const bool stopped = empty && dispatcher->stopping;
+    pthread_mutex_unlock(&dispatcher->lock);
+    return !stopped;
+}
+
+static
+void
+mouse_job_unref(mouse_job_t* const job)
+{
+    if (__atomic_sub_fetch(&job->references, 1, __ATOMIC_ACQ_REL))
+        return;
+    mouse_device_release(job->device);
+    free(job);
+}
+
+// Wakes the callers waiting on jobs, if there are any, once a job is done
+static
+void
+mouse_job_notify()
+{
+    if (!__atomic_load_n(&waiters, __ATOMIC_SEQ_CST))
+        return;
+    pthread_mutex_lock(&wait_lock);
+    pthread_cond_broadcast(&finished);
+    pthread_mutex_unlock(&wait_lock);
+}
+
+// The state is stored last, so whoever sees a finished job also sees
+// where it left the cursor
+static
+void
+mouse_job_finish(mouse_job_t* const job,
+                 const mouse_job_state_t state,
+                 const CGPoint position)
+{
+    job->position   = position;
+    job->positioned = true;
+    job->progress   = job->token.progress;
+    __atomic_store_n(&job->state, state, __ATOMIC_SEQ_CST);
+    mouse_job_notify();
+}
+
+static
+void
+mouse_dispatcher_run(mouse_job_t* const job)
+{
+    mouse_job_state_t pending = kMouseJobPending;
+    if (!__atomic_compare_exchange_n(&job->state, &pending, kMouseJobRunning,
+                                     false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return; // cancelled before it started
+
+    job->finished = mouse_perform_list(job->commands, job->count, &job->token);
+    const CGPoint position = mouse_current_position();
+
+    if (job->token.timed_out)
+        mouse_job_finish(job, kMouseJobTimedOut, position);
+    else if (mouse_token_cancelled(&job->token))
+        mouse_job_finish(job, kMouseJobCancelled, position);
+    else
+        mouse_job_finish(job, kMouseJobDone, position);
+}
+
+static
+void*
+mouse_dispatcher(void* const data)
+{
+    mouse_dispatcher_t* const dispatcher = data;
+
+    for (;;) {
+        bool busy;
+        mouse_node_t* const node = mouse_dispatcher_pop(dispatcher, &busy);
+        if (node) {
+            mouse_job_t* const job = (mouse_job_t*)node;
+            mouse_device_t* const caller = mouse_set_device(job->device);
+            mouse_dispatcher_run(job);
+            mouse_set_device(caller);
+            mouse_job_unref(job); // which may stop this dispatcher
+        }
+        else if (busy)
+            sched_yield();
+        else if (!mouse_dispatcher_sleep(dispatcher))
+            break;
+    }
+
+    pthread_mutex_destroy(&dispatcher->lock);
+    pthread_cond_destroy(&dispatcher->wake);
+    free(dispatcher);
+    return NULL;
+}
+
+// Only called once nothing refers to the device, so no more jobs will be
+// queued; the posting thread frees the dispatcher on its way out, once it
+// has seen the flag under the lock, so nothing here may touch the
+// dispatcher after unlocking it
+static
+void
+mouse_dispatcher_stop(void* const data)
+{
+    mouse_dispatcher_t* const dispatcher = data;
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->stopping = true;
+    pthread_cond_signal(&dispatcher->wake);
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+static
+void
+mouse_dispatch_forked()
+{
+    generation++;
+    pthread_mutex_init(&start_lock, NULL);
+    pthread_mutex_init(&wait_lock, NULL);
+    pthread_cond_init(&finished, NULL);
+    waiters = 0;
+}
+
+// Jobs queued before a fork are abandoned in the child, since the thread
+// that would have posted them is gone
+static
+bool
+mouse_dispatcher_start(mouse_dispatcher_t* const dispatcher)
+{
+    dispatcher->head       = &dispatcher->stub;
+    dispatcher->tail       = &dispatcher->stub;
+    dispatcher->stub.next  = NULL;
+    dispatcher->sleeping   = false;
+    dispatcher->generation = generation;
+    pthread_mutex_init(&dispatcher->lock, NULL);
+    pthread_cond_init(&dispatcher->wake, NULL);
+
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    const bool started = !pthread_create(&thread, &attributes, mouse_dispatcher, dispatcher);
+    pthread_attr_destroy(&attributes);
+    return started;
+}
+
+static
+mouse_dispatcher_t*
+mouse_dispatcher_for(mouse_device_t* const device)
+{
+    mouse_dispatcher_t* dispatcher = mouse_device_attachment(device);
+    if (dispatcher && dispatcher->generation == generation)
+        return dispatcher;
+
+    pthread_mutex_lock(&start_lock);
+    static bool registered = false;
+    if (!registered)
+        registered = !pthread_atfork(NULL, NULL, mouse_dispatch_forked);
+
+    dispatcher = mouse_device_attachment(device);
+    if (dispatcher && dispatcher->generation != generation &&
+        !mouse_dispatcher_start(dispatcher))
+        dispatcher = NULL;
+    else if (!dispatcher) {
+        dispatcher = calloc(1, sizeof(mouse_dispatcher_t));
+        if (dispatcher && mouse_dispatcher_start(dispatcher))
+            mouse_device_attach(device, dispatcher, mouse_dispatcher_stop);
+        else {
+            free(dispatcher);
+            dispatcher = NULL;
+        }
+    }
+    pthread_mutex_unlock(&start_lock);
+    return dispatcher;
+}
+
+static
+mouse_job_t*
+mouse_dispatch_job(mouse_job_t* const job)
+{
+    mouse_dispatcher_t* const dispatcher = mouse_dispatcher_for(job->device);
+    if (!dispatcher) {
+        mouse_device_release(job->device);
+        free(job);
+        return NULL;
+    }
+    mouse_dispatcher_push(dispatcher, &job->node);
+    mouse_dispatcher_wake(dispatcher);
+    return job;
+}
+
+static
+mouse_job_t*
+mouse_job_new(mouse_device_t* const device,
+              const mouse_command_t* const commands,
+              const size_t count)
+{
+    if (count > (SIZE_MAX - sizeof(mouse_job_t)) / sizeof(mouse_command_t))
+        return NULL;
+    mouse_job_t* const job = calloc(1, sizeof(mouse_job_t) + (count * sizeof(mouse_command_t)));
+    if (!job)
+        return NULL;
+    job->device     = mouse_device_retain(device ? device : mouse_device());
+    job->count      = count;
+    job->state      = kMouseJobPending;
+    job->references = 2; // the caller and the dispatcher
+    memcpy(job->commands, commands, count * sizeof(mouse_command_t));
+    return job;
+}
+
+mouse_job_t*
+mouse_dispatch(const mouse_command_t* const command)
+{
+    mouse_job_t* const job = mouse_job_new(command->device, command, 1);
+    return job ? mouse_dispatch_job(job) : NULL;
+}
+
+mouse_job_t*
+mouse_dispatch_list(const mouse_command_t* const commands, const size_t count)
+{
+    mouse_job_t* const job = mouse_job_new(NULL, commands, count);
+    return job ? mouse_dispatch_job(job) : NULL;
+}
+
+mouse_job_state_t
+mouse_job_state(mouse_job_t* const job)
+{
+    return __atomic_load_n(&job->state, __ATOMIC_SEQ_CST);
+}
+
+bool
+mouse_job_done(mouse_job_t* const job)
+{
+    const mouse_job_state_t state = mouse_job_state(job);
+    return state == kMouseJobDone || state == kMouseJobCancelled ||
+        state == kMouseJobTimedOut;
+}
+
+// A job cancelled before it started never had the posting thread look
+// for the cursor, so it is looked for here, on the job's device
+CGPoint
+mouse_job_position(mouse_job_t* const job)
+{
+    mouse_job_state(job);
+    if (job->positioned)
+        return job->position;
+
+    mouse_device_t* const caller = mouse_set_device(job->device);
+    const CGPoint position = mouse_current_position();
+    mouse_set_device(caller);
+    return position;
+}
+
+double
+mouse_job_progress(mouse_job_t* const job)
+{
+    mouse_job_state(job);
+    return job->progress;
+}
+
+size_t
+mouse_job_finished(mouse_job_t* const job)
+{
+    mouse_job_state(job);
+    return job->finished;
+}
+
+// A pending job is finished here, and skipped by the posting thread once
+// it gets to it. Nothing here goes near the backend, since this is also
+// how an interrupted Ruby thread stops the job it was waiting on.
+void
+mouse_job_cancel(mouse_job_t* const job)
+{
+    mouse_token_cancel(&job->token);
+
+    mouse_job_state_t pending = kMouseJobPending;
+    if (!__atomic_compare_exchange_n(&job->state, &pending, kMouseJobCancelled,
+                                     false, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+        return;
+
+    mouse_job_notify();
+}
+
+void
+mouse_job_wait(mouse_job_t* const job)
+{
+    pthread_mutex_lock(&wait_lock);
+    __atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+    const uint64_t interrupt = interrupts;
+    while (!mouse_job_done(job) && interrupt == interrupts)
+        pthread_cond_wait(&finished, &wait_lock);
+    __atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&wait_lock);
+}
+
+void
+mouse_dispatch_interrupt()
+{
+    pthread_mutex_lock(&wait_lock);
+    interrupts++;
+    pthread_cond_broadcast(&finished);
+    pthread_mutex_unlock(&wait_lock);
+}
+
+void
+mouse_job_release(mouse_job_t* const job)
+{
+    mouse_job_unref(job);
+}
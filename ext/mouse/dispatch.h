@@ -0,0 +1,61 @@
+//
+//  dispatch.h
+//  MRMouse
+//
+//  Jobs are commands queued up for the posting thread of a device, which
+//  performs them one at a time in the order that they were dispatched, so
+//  that operations started from different threads never interleave their
+//  events.
+//
+
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include "command.h"
+
+typedef enum {
+    kMouseJobPending,
+    kMouseJobRunning,
+    kMouseJobDone,
+    kMouseJobCancelled,
+    kMouseJobTimedOut,
+} mouse_job_state_t;
+
+typedef struct mouse_job mouse_job_t;
+
+// Queues `command` and returns a job that must be given back to
+// mouse_job_release() once the caller no longer needs it. The job runs on
+// the command's device, or on the caller's current one, which it keeps
+// until it is released.
+mouse_job_t* mouse_dispatch(const mouse_command_t* const command);
+
+// Queues the commands as a single job on the caller's current device,
+// which performs them like mouse_perform_list(). The commands are copied,
+// but anything they point to, such as a path or a trace, must outlive
+// the job: cancel the job and wait for it to be done before letting go.
+mouse_job_t* mouse_dispatch_list(const mouse_command_t* const commands, const size_t count);
+
+mouse_job_state_t mouse_job_state(mouse_job_t* const job);
+bool mouse_job_done(mouse_job_t* const job);
+
+// Where the cursor was once the job finished
+CGPoint mouse_job_position(mouse_job_t* const job);
+
+// How much of the job's animation was posted before the job finished
+double mouse_job_progress(mouse_job_t* const job);
+
+// How many of the job's commands finished, once the job is done
+size_t mouse_job_finished(mouse_job_t* const job);
+
+// A pending job is skipped, a running job stops at its next frame. Safe
+// to call from an unblocking function, since it never blocks on the
+// backend.
+void mouse_job_cancel(mouse_job_t* const job);
+
+// Blocks until the job is done, or until mouse_dispatch_interrupt() is called
+void mouse_job_wait(mouse_job_t* const job);
+void mouse_dispatch_interrupt(void);
+
+void mouse_job_release(mouse_job_t* const job);
+
+#endif
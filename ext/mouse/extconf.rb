@@ -1,19 +1,51 @@
 require 'mkmf'
 
-$CFLAGS << ' -std=c99 -Weverything'
-$CFLAGS << ' -Wno-disabled-macro-expansion -Wno-gnu -Wno-documentation'
-# @todo REALLY NEED TO CLEAR ALL THESE WARNINGS
-$CFLAGS << ' -Wno-conversion'
-
-$LIBS   << ' -framework Foundation'
-$LIBS   << ' -framework ApplicationServices'
-$LIBS   << ' -framework CoreGraphics'
-
-unless RbConfig::CONFIG['CC'].match(/clang/)
-  clang = `which clang`.chomp
-  fail 'Clang not installed. Cannot build C extension' if clang.empty?
-  RbConfig::MAKEFILE_CONFIG['CC']  = clang
-  RbConfig::MAKEFILE_CONFIG['CXX'] = clang
+if RbConfig::CONFIG['host_os'] =~ /darwin/
+  $CFLAGS << ' -std=c99 -Weverything'
+  $CFLAGS << ' -Wno-disabled-macro-expansion -Wno-gnu -Wno-documentation'
+  # @todo REALLY NEED TO CLEAR ALL THESE WARNINGS
+  $CFLAGS << ' -Wno-conversion'
+
+  $LIBS   << ' -framework Foundation'
+  $LIBS   << ' -framework ApplicationServices'
+  $LIBS   << ' -framework CoreGraphics'
+
+  unless RbConfig::CONFIG['CC'].match(/clang/)
+    clang = `which clang`.chomp
+    fail 'Clang not installed. Cannot build C extension' if clang.empty?
+    RbConfig::MAKEFILE_CONFIG['CC']  = clang
+    RbConfig::MAKEFILE_CONFIG['CXX'] = clang
+  end
+else
+  # Without a window server, events go to the memory backend, see backend.h
+  $CFLAGS << ' -std=c99 -D_GNU_SOURCE -Wall -Wextra -Wno-old-style-definition'
+  $LIBS   << ' -lpthread -lm'
+
+  # MOUSE_BACKEND=x11 drives the X server on DISPLAY, such as an Xvfb
+  if have_header('X11/extensions/XTest.h') &&
+     have_library('X11', 'XOpenDisplay') &&
+     have_library('Xtst', 'XTestFakeMotionEvent')
+    $defs << '-DMOUSE_X11'
+  end
+
+  # MOUSE_BACKEND=uinput posts through a virtual pointer in the kernel
+  $defs << '-DMOUSE_UINPUT' if have_header('linux/uinput.h')
+end
+
+# Ruby 2.6+ can wait for a call without first raising a pending interrupt
+have_func 'rb_nogvl', 'ruby/thread.h'
+
+# Ruby 3.0+ lets Mouse.follow_path read paths out of memory views
+have_header 'ruby/memory_view.h'
+
+# Static probes for bpftrace, perf or DTrace, see probes.h;
+# gem install mouse -- --enable-usdt
+if enable_config('usdt', false)
+  if have_header('sys/sdt.h')
+    $defs << '-DMOUSE_USDT'
+  else
+    warn 'sys/sdt.h not found, building without static probes'
+  end
 end
 
 create_makefile 'mouse/mouse'
@@ -1,17 +1,40 @@
-#include "mouser.h"
+#include "dispatch.h"
+#include "plan.h"
+#include "recorder.h"
+#include "stats.h"
 #include "ruby.h"
+#include "ruby/thread.h"
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+#include "ruby/memory_view.h"
+#endif
 
 #ifndef UNUSED
 #define UNUSED __attribute__ ((unused))
 #endif
 
 
-static VALUE rb_mMouse, rb_cCGPoint;
+static VALUE rb_mMouse, rb_cCGPoint, rb_cHandle, rb_cToken, rb_cBatch, rb_cDevice;
+
+static VALUE rb_mRecorder, rb_cRecorderEvent, rb_mMemory;
+
+static VALUE rb_eCancelled, rb_eTimeout;
 
 static ID sel_x, sel_y, sel_to_point, sel_new;
 
+static VALUE sym_created, sym_posted, sym_dropped, sym_fps, sym_timeout, sym_cancel, sym_profile;
+
+static VALUE sym_frames, sym_duration, sym_cached;
+
+static VALUE sym_lateness, sym_operations, sym_count, sym_mean, sym_max,
+    sym_p50, sym_p90, sym_p99, sym_p999, sym_histogram,
+    sym_frames_planned, sym_frames_posted, sym_frames_coalesced;
+
+static VALUE sym_linear, sym_ease_in_out, sym_minimum_jerk, sym_s_curve;
+
 static VALUE sym_pixel, sym_line,
-    sym_up, sym_down, sym_left, sym_right,
+    sym_up, sym_down, sym_left, sym_right, sym_middle,
+    sym_button, sym_hold, sym_interval,
+    sym_backend, sym_dead_reckoning, sym_time_warp, sym_coalesce,
     sym_zoom, sym_unzoom, sym_expand, sym_contract,
     sym_cw, sym_clockwise, sym_clock_wise,
     sym_ccw, sym_counter_clockwise, sym_counter_clock_wise;
@@ -25,940 +48,2909 @@ rb_mouse_wrap_point(const CGPoint point)
     return rb_struct_new(rb_cCGPoint, DBL2NUM(point.x), DBL2NUM(point.y));
 }
 
+// Points and arrays are common enough to skip calling #to_point on them,
+// which would allocate a CGPoint for every array
 static
 CGPoint
 rb_mouse_unwrap_point(const VALUE maybe_point)
 {
-    const VALUE point = rb_funcall(maybe_point, sel_to_point, 0);
+    if (RB_TYPE_P(maybe_point, T_ARRAY) && RARRAY_LEN(maybe_point) >= 2)
+        return CGPointMake(NUM2DBL(RARRAY_AREF(maybe_point, 0)),
+                           NUM2DBL(RARRAY_AREF(maybe_point, 1)));
+
+    const VALUE point = rb_obj_class(maybe_point) == rb_cCGPoint ?
+        maybe_point : rb_funcall(maybe_point, sel_to_point, 0);
     const double x = NUM2DBL(rb_struct_getmember(point, sel_x));
     const double y = NUM2DBL(rb_struct_getmember(point, sel_y));
     return CGPointMake(x, y);
 }
 
-/*
- * Returns the current co-ordinates of the mouse cursor
- *
- * @return [CGPoint]
- */
 static
-VALUE
-rb_mouse_current_position(UNUSED const VALUE self)
+void
+rb_mouse_unwrap_command_point(mouse_command_t* const command,
+                              const VALUE maybe_point)
 {
-    return CURRENT_POSITION;
+    command->has_point = true;
+    command->point     = rb_mouse_unwrap_point(maybe_point);
+}
+
+static
+CGScrollEventUnit
+rb_mouse_unwrap_units(const VALUE input_units)
+{
+    if (input_units == sym_pixel)
+        return kCGScrollEventUnitPixel;
+    else if (input_units == sym_line)
+        return kCGScrollEventUnitLine;
+
+    rb_raise(rb_eArgError,
+             "unknown units `%s'",
+             rb_id2name(SYM2ID(input_units)));
+}
+
+// Returns the job, so that a caller can tell whether it ran at all
+static
+void*
+rb_mouse_wait_without_gvl(void* const job)
+{
+    while (!mouse_job_done(job))
+        mouse_job_wait(job);
+    return job;
+}
+
+static
+void
+rb_mouse_cancel_call(void* const job)
+{
+    mouse_job_cancel(job);
 }
 
-/*
- * Move the mouse cursor to the given co-ordinates
- *
- * The default duration is 0.2 seconds.
- *
- * @overload move_to(point)
- *   @param point [CGPoint,Array(Number,Number),#to_point]
- *   @return [CGPoint]
- * @overload move_to(point, duration)
- *   @param point [CGPoint,Array(Number,Number),#to_point]
- *   @param duration [Number] animation time, in seconds
- *   @return [CGPoint]
- */
+static
+void
+rb_mouse_raise_stopped(const bool timed_out, const double progress, const CGPoint position)
+{
+    const VALUE exception =
+        rb_exc_new_str(timed_out ? rb_eTimeout : rb_eCancelled,
+                       rb_sprintf("%s %s %d%% of the way through",
+                                  rb_id2name(rb_frame_this_func()),
+                                  timed_out ? "timed out" : "was cancelled",
+                                  (int)(progress * 100)));
+    rb_iv_set(exception, "@progress", DBL2NUM(progress));
+    rb_iv_set(exception, "@position", rb_mouse_wrap_point(position));
+    rb_exc_raise(exception);
+}
+
+// What became of a job performed on behalf of a direct call
+typedef struct {
+    mouse_job_t* job;
+    size_t  finished;
+    bool   timed_out;
+    double  progress;
+    CGPoint position;
+} rb_mouse_call_t;
+
 static
 VALUE
-rb_mouse_move_to(const int argc,
-                 VALUE* const argv,
-                 UNUSED const VALUE self)
+rb_mouse_await_call(const VALUE data)
 {
-    switch (argc) {
-    case 0:
-        rb_raise(rb_eArgError, "move_to requires at least a one arg");
-    case 1:
-        mouse_move_to(rb_mouse_unwrap_point(argv[0]));
-        break;
-    case 2:
-    default:
-        mouse_move_to2(rb_mouse_unwrap_point(argv[0]), NUM2DBL(argv[1]));
+    rb_mouse_call_t* const call = (rb_mouse_call_t*)data;
+    mouse_job_t* const job = call->job;
+
+    while (!mouse_job_done(job)) {
+#ifdef HAVE_RB_NOGVL
+        // fails without waiting if an interrupt is already pending, which
+        // is then raised below and stops the job on the way out
+        rb_nogvl(rb_mouse_wait_without_gvl, job, rb_mouse_cancel_call, job, RB_NOGVL_INTR_FAIL);
+#else
+        rb_thread_call_without_gvl(rb_mouse_wait_without_gvl, job, rb_mouse_cancel_call, job);
+#endif
+        rb_thread_check_ints();
     }
 
-    return CURRENT_POSITION;
+    call->finished  = mouse_job_finished(job);
+    call->timed_out = mouse_job_state(job) == kMouseJobTimedOut;
+    call->progress  = mouse_job_progress(job);
+    call->position  = mouse_job_position(job);
+    return Qnil;
 }
 
-/*
- * Drag the mouse cursor to the given co-ordinates
- *
- * @param (see #move_to)
- * @return [CGPoint]
- */
+// However the caller leaves, the job is stopped and done before the paths,
+// views and traces that its commands point to can be let go. A cancelled
+// job only has to get to its next frame, so if another interrupt is
+// already pending this waits for it with the GVL held rather than not at
+// all.
 static
 VALUE
-rb_mouse_drag_to(const int argc,
-                 VALUE* const argv,
-                 UNUSED const VALUE self)
+rb_mouse_settle_call(const VALUE data)
 {
-    switch (argc) {
-    case 0:
-        rb_raise(rb_eArgError, "drag_to requires at least a one arg");
-    case 1:
-        mouse_drag_to(rb_mouse_unwrap_point(argv[0]));
-        break;
-    case 2:
-    default:
-        mouse_drag_to2(rb_mouse_unwrap_point(argv[0]), NUM2DBL(argv[1]));
+    rb_mouse_call_t* const call = (rb_mouse_call_t*)data;
+    mouse_job_t* const job = call->job;
+
+    if (!mouse_job_done(job)) {
+        mouse_job_cancel(job);
+#ifdef HAVE_RB_NOGVL
+        if (!rb_nogvl(rb_mouse_wait_without_gvl, job, NULL, NULL, RB_NOGVL_INTR_FAIL))
+#endif
+            rb_mouse_wait_without_gvl(job);
     }
+    mouse_job_release(job);
+    return Qnil;
+}
 
-    return CURRENT_POSITION;
+// Queues the commands as one job on the posting thread of the current
+// device, which performs everything queued from every thread in turn, and
+// waits for them without holding the GVL, so that other Ruby threads keep
+// running during animations and holds. If the calling thread is
+// interrupted (Thread#raise, Timeout, Ctrl-C), even before it starts
+// waiting, the job is cancelled and stops at its next frame, or is
+// skipped if it had not started. A command that was stopped early by its
+// own timeout or cancel token raises once any held buttons are let go,
+// and the commands after it are skipped.
+static
+void
+rb_mouse_perform_list(const mouse_command_t* const commands, const size_t count)
+{
+    rb_mouse_call_t call = { .job = mouse_dispatch_list(commands, count) };
+    if (!call.job)
+        rb_memerror();
+    rb_ensure(rb_mouse_await_call, (VALUE)&call, rb_mouse_settle_call, (VALUE)&call);
+
+    if (call.finished < count) {
+        const mouse_command_t* const stopped = &commands[call.finished];
+        if (call.timed_out || (stopped->cancel && mouse_token_cancelled(stopped->cancel)))
+            rb_mouse_raise_stopped(call.timed_out, call.progress, call.position);
+    }
 }
 
-/*
- * @note Scrolling by `:pixel` may not actually be by real pixels, but instead
- *       correspond to Cocoa co-ords (I don't have a retina display, so I
- *       haven't checked it out yet).
- *
- * Generate `amount` scroll events at the current cursor position
- *
- * Returns number of lines/pixels scrolled, default `units` are by `line`.
- * A positive `amount` will scroll up and a negative `amount` will scroll down.
- *
- * An animation duration can also be specified, which defaults to 0.2 seconds.
- *
- * @overload scroll(amount)
- *   @param amount [Number]
- *   @return [Number]
- * @overload scroll(amount, units)
- *   @param amount [Number]
- *   @param units [Symbol] `:pixel` or `:line`
- *   @return [Number]
- * @overload scroll(amount, units, duration)
- *   @param amount [Number]
- *   @param units [Symbol] `:pixel` or `:line`
- *   @param duration [Number] animation time, in seconds
- *   @return [Number]
- */
 static
-VALUE
-rb_mouse_scroll(const int argc, VALUE* const argv, UNUSED const VALUE self)
+void
+rb_mouse_perform(const mouse_command_t* const command)
 {
-    if (argc == 0 || argc > 3)
-        rb_raise(rb_eArgError,
-                 "scroll requires 1..3 arguments, you gave %d",
-                 argc);
+    rb_mouse_perform_list(command, 1);
+}
 
-    const int amt = NUM2INT(argv[0]);
+typedef struct {
+    double                fps;
+    mouse_profile_t   profile;
+    double            timeout;
+    const mouse_token_t* cancel;
+} rb_mouse_options_t;
 
-    if (argc == 1) {
-        mouse_scroll(amt);
+static
+double
+rb_mouse_unwrap_fps(const VALUE maybe_fps)
+{
+    const double fps = NUM2DBL(maybe_fps);
+    if (!(fps > 0 && fps <= MAX_FPS))
+        rb_raise(rb_eArgError,
+                 "fps must be more than 0 and at most %g, you gave %g",
+                 MAX_FPS,
+                 fps);
+    return fps;
+}
 
-    } else {
-        const VALUE input_units = argv[1];
-        CGScrollEventUnit units = kCGScrollEventUnitLine;
+static
+double
+rb_mouse_unwrap_duration(const VALUE maybe_duration)
+{
+    const double duration = NUM2DBL(maybe_duration);
+    if (!(duration >= 0 && isfinite(duration)))
+        rb_raise(rb_eArgError,
+                 "duration must be a finite number of seconds, at least 0, you gave %g",
+                 duration);
+    return duration;
+}
 
-        if (input_units == sym_pixel)
-            units = kCGScrollEventUnitPixel;
-        else if (input_units == sym_line)
-            units = kCGScrollEventUnitLine;
-        else
-            rb_raise(rb_eArgError,
-                     "unknown units `%s'",
-                     rb_id2name(SYM2ID(input_units)));
+static
+mouse_profile_t
+rb_mouse_unwrap_profile(const VALUE profile)
+{
+    if (profile == sym_linear)
+        return kMouseProfileLinear;
+    else if (profile == sym_ease_in_out)
+        return kMouseProfileEaseInOut;
+    else if (profile == sym_minimum_jerk)
+        return kMouseProfileMinimumJerk;
+    else if (profile == sym_s_curve)
+        return kMouseProfileSCurve;
+
+    rb_raise(rb_eArgError,
+             "unknown motion profile %s",
+             RSTRING_PTR(rb_inspect(profile)));
+}
 
-        if (argc == 2)
-            mouse_scroll2(amt, units);
-        else
-            mouse_scroll3(amt, units, NUM2DBL(argv[2]));
+static
+VALUE
+rb_mouse_wrap_profile(const mouse_profile_t profile)
+{
+    switch (profile) {
+    case kMouseProfileEaseInOut:   return sym_ease_in_out;
+    case kMouseProfileMinimumJerk: return sym_minimum_jerk;
+    case kMouseProfileSCurve:      return sym_s_curve;
+    case kMouseProfileLinear:
+    default:                       return sym_linear;
     }
+}
 
-    return argv[0];
+static const rb_data_type_t rb_mouse_token_type = {
+    .wrap_struct_name = "Mouse::Token",
+    .function = {
+        .dfree = RUBY_TYPED_DEFAULT_FREE
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static
+mouse_token_t*
+rb_mouse_unwrap_token(const VALUE token)
+{
+    return rb_check_typeddata(token, &rb_mouse_token_type);
 }
 
-/*
- * @note Scrolling by `:pixel` may not actually be by real pixels, but instead
- *       correspond to Cocoa co-ords (I don't have a retina display, so I haven't
- *       checked it out yet).
- *
- * Generate `amount` of horizontal scroll events at the current cursor position
- *
- * Returns number of lines/pixels scrolled, default `units` are by `line`.
- * A positive `amount` will scroll up and a negative `amount` will scroll down.
- *
- * An animation duration can also be specified, which defaults to 0.2 seconds.
- *
- * @overload horizontal_scroll(amount)
- *   @param amount [Number]
- *   @return [Number]
- * @overload horizontal_scroll(amount, units)
- *   @param amount [Number]
- *   @param units [Symbol] `:pixel` or `:line`
- *   @return [Number]
- * @overload horizontal_scroll(amount, units, duration)
- *   @param amount [Number]
- *   @param units [Symbol] `:pixel` or `:line`
- *   @param duration [Number] animation time, in seconds
- *   @return [Number]
- */
+// Pops the trailing hash of keyword options, if any, off of the argument list
 static
-VALUE
-rb_mouse_horizontal_scroll(const int argc,
-                           VALUE* const argv,
-                           UNUSED const VALUE self)
+rb_mouse_options_t
+rb_mouse_unwrap_options(int* const argc, VALUE* const argv)
 {
-    if (argc == 0 || argc > 3)
-        rb_raise(rb_eArgError,
-                 "scroll requires 1..3 arguments, you gave %d",
-                 argc);
+    rb_mouse_options_t options = {
+        .fps     = mouse_fps(),
+        .profile = mouse_profile()
+    };
 
-    const int amt = NUM2INT(argv[0]);
+    if (!*argc || !RB_TYPE_P(argv[*argc - 1], T_HASH))
+        return options;
 
-    if (argc == 1) {
-        mouse_horizontal_scroll(amt);
+    const VALUE hash = argv[--(*argc)];
+    size_t  consumed = 0;
 
-    } else {
-        const VALUE input_units = argv[1];
-        CGScrollEventUnit units = kCGScrollEventUnitLine;
+    const VALUE fps = rb_hash_lookup2(hash, sym_fps, Qundef);
+    if (fps != Qundef) {
+        options.fps = rb_mouse_unwrap_fps(fps);
+        consumed++;
+    }
 
-        if (input_units == sym_pixel)
-            units = kCGScrollEventUnitPixel;
-        else if (input_units == sym_line)
-            units = kCGScrollEventUnitLine;
-        else
-            rb_raise(rb_eArgError,
-                     "unknown units `%s'",
-                     rb_id2name(SYM2ID(input_units)));
+    const VALUE profile = rb_hash_lookup2(hash, sym_profile, Qundef);
+    if (profile != Qundef) {
+        options.profile = rb_mouse_unwrap_profile(profile);
+        consumed++;
+    }
 
-        if (argc == 2)
-            mouse_horizontal_scroll2(amt, units);
-        else
-            mouse_horizontal_scroll3(amt, units, NUM2DBL(argv[2]));
+    const VALUE timeout = rb_hash_lookup2(hash, sym_timeout, Qundef);
+    if (timeout != Qundef) {
+        if (!NIL_P(timeout)) {
+            options.timeout = NUM2DBL(timeout);
+            if (!(options.timeout > 0 && options.timeout <= MAX_TIMEOUT))
+                rb_raise(rb_eArgError,
+                         "timeout must be more than 0 and at most %g seconds, you gave %g",
+                         MAX_TIMEOUT, options.timeout);
+        }
+        consumed++;
     }
 
-    return argv[0];
+    const VALUE cancel = rb_hash_lookup2(hash, sym_cancel, Qundef);
+    if (cancel != Qundef) {
+        if (!NIL_P(cancel))
+            options.cancel = rb_mouse_unwrap_token(cancel);
+        consumed++;
+    }
+
+    if ((size_t)RHASH_SIZE(hash) != consumed)
+        rb_raise(rb_eArgError,
+                 "unknown keyword in %s",
+                 RSTRING_PTR(rb_inspect(hash)));
+
+    return options;
 }
 
 /*
- * Generate the down click part of a click event
- *
- * This might be useful in concert with {Mouse.click_up} if you want
- * to inject some behaviour between the down and up click events.
- *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * Returns the current co-ordinates of the mouse cursor
  *
- * @overload click_down()
- *   @return [CGPoint]
- * @overload click_down(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @return [CGPoint]
  */
 static
 VALUE
-rb_mouse_click_down(const int argc,
-                    VALUE* const argv,
-                    UNUSED const VALUE self)
+rb_mouse_current_position(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_click_down();
-        break;
-    case 1:
-    default:
-        mouse_click_down2(rb_mouse_unwrap_point(argv[0]));
-    }
-
     return CURRENT_POSITION;
 }
 
 /*
- * Generate the up click part of a click event
+ * Name of the backend that events are posted to
  *
- * This might be useful in concert with {Mouse.click_down} if you want
- * to inject some behaviour between the down and up click events.
+ * The backend is chosen when the library is loaded, from the
+ * `MOUSE_BACKEND` environment variable if it is set. By default events
+ * go to the window server through CoreGraphics on OS X, and into memory
+ * everywhere else; `x11` sends them to the X server on `DISPLAY`
+ * through XTest, and `uinput` through a virtual pointer in the Linux
+ * kernel, when the extension was built with them.
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * @example
  *
- * @overload click_up()
- *   @return [CGPoint]
- * @overload click_up(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ *   # MOUSE_BACKEND=memory ruby -rmouse -e 'p Mouse.backend'
+ *   Mouse.backend # => "memory"
+ *
+ * @return [String]
  */
 static
 VALUE
-rb_mouse_click_up(const int argc, VALUE* const argv, UNUSED const VALUE self)
+rb_mouse_backend(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_click_up();
-        break;
-    case 1:
-    default:
-        mouse_click_up2(rb_mouse_unwrap_point(argv[0]));
-    }
-
-    return CURRENT_POSITION;
+    return rb_str_new_cstr(mouse_backend()->name);
 }
 
 /*
- * Generate a regular click event (both up and down events)
+ * @api private
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * Running totals of the events created and posted by the library, and
+ * of those posted that the backend failed to deliver
  *
- * @overload click()
- *   @return [CGPoint]
- * @overload click()
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * An animation should create the same number of events no matter
+ * how many frames it runs for.
+ *
+ * @return [Hash{Symbol=>Number}]
  */
 static
 VALUE
-rb_mouse_click(const int argc, VALUE* const argv, UNUSED const VALUE self)
+rb_mouse_event_counts(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_click();
-        break;
-    case 1:
-    default:
-        mouse_click2(rb_mouse_unwrap_point(argv[0]));
-    }
+    const mouse_event_counts_t counts = mouse_event_counts();
+    const VALUE hash = rb_hash_new();
+    rb_hash_aset(hash, sym_created, SIZET2NUM(counts.created));
+    rb_hash_aset(hash, sym_posted,  SIZET2NUM(counts.posted));
+    rb_hash_aset(hash, sym_dropped, SIZET2NUM(counts.dropped));
+    return hash;
+}
 
-    return CURRENT_POSITION;
+#define SECONDS(nanoseconds) DBL2NUM((double)(nanoseconds) / 1000000000)
+
+static
+VALUE
+rb_mouse_wrap_histogram(const mouse_histogram_t* const histogram)
+{
+    const VALUE buckets = rb_ary_new();
+    for (size_t i = 0; i < MOUSE_HISTOGRAM_BUCKETS; i++)
+        if (histogram->buckets[i])
+            rb_ary_push(buckets,
+                        rb_assoc_new(SECONDS(mouse_histogram_bucket_limit(i)),
+                                     ULL2NUM(histogram->buckets[i])));
+
+    const VALUE hash = rb_hash_new();
+    rb_hash_aset(hash, sym_count, ULL2NUM(histogram->count));
+    rb_hash_aset(hash, sym_mean,
+                 SECONDS(histogram->count ? (double)histogram->sum / histogram->count : 0));
+    rb_hash_aset(hash, sym_max,   SECONDS(histogram->max));
+    rb_hash_aset(hash, sym_p50,   SECONDS(mouse_histogram_percentile(histogram, 50)));
+    rb_hash_aset(hash, sym_p90,   SECONDS(mouse_histogram_percentile(histogram, 90)));
+    rb_hash_aset(hash, sym_p99,   SECONDS(mouse_histogram_percentile(histogram, 99)));
+    rb_hash_aset(hash, sym_p999,  SECONDS(mouse_histogram_percentile(histogram, 99.9)));
+    rb_hash_aset(hash, sym_histogram, buckets);
+    return hash;
 }
 
 /*
- * Generate the down click part of a secondary/right click event
+ * Statistics about how well operations have kept to their schedule
+ * since the extension was loaded or {Mouse.reset_stats} was last called
  *
- * This might be useful in concert with {Mouse.secondary_click_up} if
- * you want to inject some behaviour between the down and up click
- * events.
+ * `:lateness` is how long after its deadline each animation frame was
+ * posted. `:operations` has the wall time of each kind of operation,
+ * along with how many frames were planned, how many were posted and
+ * how many were coalesced to catch up with the schedule (see
+ * {Mouse.coalesce=}); operations that are stopped early post fewer
+ * frames than they planned.
+ * Clicks with any button are counted together, as are double and
+ * triple clicks with multi clicks.
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * Times are in seconds. Percentiles are accurate to within 1/16 of the
+ * value, and `:histogram` lists the upper bound and count of every
+ * bucket that has something in it.
  *
- * @overload secondary_click_down()
- *   @return [CGPoint]
- * @overload secondary_click_down(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @example
+ *
+ *   Mouse.stats[:lateness][:p99]                 # => 0.000412
+ *   Mouse.stats[:operations][:move_to][:count]   # => 12
+ *
+ * @return [Hash{Symbol=>Hash}]
  */
 static
 VALUE
-rb_mouse_secondary_click_down(const int argc,
-                              VALUE* const argv,
-                              UNUSED const VALUE self)
+rb_mouse_stats(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_secondary_click_down();
-        break;
-    case 1:
-    default:
-        mouse_secondary_click_down2(rb_mouse_unwrap_point(argv[0]));
+    VALUE buffer;
+    mouse_stats_t* const stats = ALLOCV(buffer, sizeof(mouse_stats_t));
+    mouse_device_stats(stats);
+
+    const VALUE operations = rb_hash_new();
+    for (size_t i = 0; i < kMouseStatsOperations; i++) {
+        const mouse_operation_stats_t* const op = &stats->operations[i];
+        const VALUE hash = rb_mouse_wrap_histogram(&op->wall_time);
+        rb_hash_aset(hash, sym_frames_planned, ULL2NUM(op->frames_planned));
+        rb_hash_aset(hash, sym_frames_posted,  ULL2NUM(op->frames_posted));
+        rb_hash_aset(hash, sym_frames_coalesced, ULL2NUM(op->frames_coalesced));
+        rb_hash_aset(operations, ID2SYM(rb_intern(mouse_stats_operation_name(i))), hash);
     }
 
-    return CURRENT_POSITION;
+    const VALUE result = rb_hash_new();
+    rb_hash_aset(result, sym_lateness,   rb_mouse_wrap_histogram(&stats->lateness));
+    rb_hash_aset(result, sym_operations, operations);
+    ALLOCV_END(buffer);
+    return result;
 }
 
 /*
- * Generate the up click part of a secondary/right click event
- *
- * This might be useful in concert with {Mouse.secondary_click_down} if
- * you want to inject some behaviour between the down and up click events.
- *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * Forget the statistics gathered so far
  *
- * @overload secondary_click_up()
- *   @return [CGPoint]
- * @overload secondary_click_up(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @return [nil]
  */
 static
 VALUE
-rb_mouse_secondary_click_up(const int argc,
-                            VALUE* const argv,
-                            UNUSED const VALUE self)
+rb_mouse_reset_stats(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_secondary_click_up();
-        break;
-    case 1:
-    default:
-        mouse_secondary_click_up2(rb_mouse_unwrap_point(argv[0]));
-    }
-
-    return CURRENT_POSITION;
+    mouse_device_reset_stats();
+    return Qnil;
 }
 
 /*
- * Generate a secondary click (both down and up events)
- *
- * Secondary click is often referred to as "right click".
- *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * The frame rate used for animations, unless a call asks for another
  *
- * @overload secondary_click()
- *   @return [CGPoint]
- * @overload secondary_click(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @return [Float]
  */
 static
 VALUE
-rb_mouse_secondary_click(const int argc,
-                         VALUE* const argv,
-                         UNUSED const VALUE self)
+rb_mouse_fps(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_secondary_click();
-        break;
-    case 1:
-    default:
-        mouse_secondary_click2(rb_mouse_unwrap_point(argv[0]));
-    }
-
-    return CURRENT_POSITION;
+    return DBL2NUM(mouse_fps());
 }
 
 /*
- * Generate the down click part of an arbitrary click event
+ * Set the frame rate used for animations
  *
- * This might be useful in concert with {Mouse.arbitrary_click_up} if
- * you want to inject some behaviour between the down and up click
- * events.
+ * The default is 240 frames per second. Lower rates are cheaper to
+ * post and higher rates, up to 1000 frames per second, suit apps that
+ * sample input more often.
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * Animated methods also take an `fps:` option to override this for
+ * a single call.
  *
- * @overload arbitrary_click_down()
- *   @return [CGPoint]
- * @overload arbitrary_click_down(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @param fps [Number]
+ * @return [Number]
  */
 static
 VALUE
-rb_mouse_arbitrary_click_down(const int argc,
-                              VALUE* const argv,
-                              UNUSED const VALUE self)
+rb_mouse_set_fps(UNUSED const VALUE self, const VALUE fps)
 {
-    if (argc == 0)
-        rb_raise(rb_eArgError,
-                 "arbitrary_click_down requires at least one arg");
+    mouse_set_fps(rb_mouse_unwrap_fps(fps));
+    return fps;
+}
 
-    const uint_t button = NUM2UINT(argv[0]);
+/*
+ * The motion profile used by {Mouse.move_to} and {Mouse.drag_to}
+ *
+ * @return [Symbol]
+ */
+static
+VALUE
+rb_mouse_profile(UNUSED const VALUE self)
+{
+    return rb_mouse_wrap_profile(mouse_profile());
+}
 
-    switch (argc) {
-    case 1:
-        mouse_arbitrary_click_down(button);
-        break;
-    case 2:
-    default:
-        mouse_arbitrary_click_down2(button, rb_mouse_unwrap_point(argv[1]));
-    }
+/*
+ * Set how {Mouse.move_to} and {Mouse.drag_to} pace their animations
+ *
+ * - `:linear` moves at a constant speed, starting and stopping abruptly;
+ *   this is the default
+ * - `:ease_in_out` speeds up and slows down smoothly
+ * - `:minimum_jerk` follows the path that a hand tends to take when
+ *   reaching for a target
+ * - `:s_curve` speeds up over the first quarter of the animation,
+ *   cruises, and slows down over the last quarter
+ *
+ * Apps that look at how fast the cursor moves, for instance to decide
+ * whether a drag has started, tend to register the smoother profiles
+ * reliably at shorter durations. Both methods also take a `profile:`
+ * option to override this for a single call.
+ *
+ * @param profile [Symbol]
+ * @return [Symbol]
+ */
+static
+VALUE
+rb_mouse_set_profile(UNUSED const VALUE self, const VALUE profile)
+{
+    mouse_set_profile(rb_mouse_unwrap_profile(profile));
+    return profile;
+}
 
-    return CURRENT_POSITION;
+/*
+ * Whether or not animations track the cursor by dead reckoning
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_dead_reckoning(UNUSED const VALUE self)
+{
+    return mouse_dead_reckoning() ? Qtrue : Qfalse;
 }
 
 /*
- * Generate the up click part of an arbitrary click event
+ * Choose how animations keep track of the mouse cursor
  *
- * This might be useful in concert with {Mouse.arbitrary_click_down} if
- * you want to inject some behaviour between the down and up click events.
+ * By default, each frame of {Mouse.move_to} and {Mouse.drag_to} asks the
+ * system where the cursor is and steps from there, which costs a round
+ * trip to the window server for every frame.
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * With dead reckoning enabled, animations assume the cursor is wherever
+ * the previous frame put it and only check the real position once the
+ * animation is finished, correcting it if something else moved the
+ * cursor in the meantime.
  *
- * @overload arbitrary_click_up()
- *   @return [CGPoint]
- * @overload arbitrary_click_up(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @param enabled [Boolean]
+ * @return [Boolean]
  */
 static
 VALUE
-rb_mouse_arbitrary_click_up(const int argc,
-                            VALUE* const argv,
-                            UNUSED const VALUE self)
+rb_mouse_set_dead_reckoning(UNUSED const VALUE self, const VALUE enabled)
 {
-    if (argc == 0)
-        rb_raise(rb_eArgError,
-                 "arbitrary_click_up requires at least one arg");
+    mouse_set_dead_reckoning(RTEST(enabled));
+    return enabled;
+}
 
-    const uint_t button = NUM2UINT(argv[0]);
+/*
+ * Whether or not late moves are coalesced
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_coalesce(UNUSED const VALUE self)
+{
+    return mouse_coalesce() ? Qtrue : Qfalse;
+}
 
-    switch (argc) {
-    case 1:
-        mouse_arbitrary_click_up(button);
-        break;
-    case 2:
-    default:
-        mouse_arbitrary_click_up2(button, rb_mouse_unwrap_point(argv[1]));
-    }
+/*
+ * Skip the moves of an animation that has fallen behind
+ *
+ * When the thread posting an animation falls at least two frames behind,
+ * because the machine is busy or the backend blocked, the moves that
+ * are already late are not posted; only the newest position is, so that
+ * the animation still ends when it was meant to. Being a single frame
+ * late is left to catch up on its own. Replays skip a move or drag
+ * once the record after the next one is due. Button presses and
+ * releases, scrolls and gestures are never skipped.
+ *
+ * How many frames were skipped is reported as `:frames_coalesced` in
+ * {Mouse.stats}. It is on by default; turn it off to have every frame
+ * posted, however late.
+ *
+ * @param enabled [Boolean]
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_set_coalesce(UNUSED const VALUE self, const VALUE enabled)
+{
+    mouse_set_coalesce(RTEST(enabled));
+    return enabled;
+}
 
-    return CURRENT_POSITION;
+/*
+ * Whether or not the clock is warped
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_time_warp(UNUSED const VALUE self)
+{
+    return mouse_time_warp() ? Qtrue : Qfalse;
 }
 
 /*
- * Generate a click using an arbitrary mouse button (down and up events)
+ * Skip the waits between frames
  *
- * Numbers are used to map the mouse buttons. At the time of writing,
- * the documented values are:
+ * With the clock warped, animations, holds and replays jump the clock
+ * ahead to when each frame is due instead of sleeping until then, so
+ * they finish as fast as events can be posted. Each event is still
+ * stamped with the time it would have been posted at, as seen in
+ * {Mouse::Recorder} and {Mouse::Memory}; the `coregraphics` backend
+ * passes the stamp on to the window server, but the `x11` and `uinput`
+ * backends cannot, so what receives their events sees them all at once.
  *
- *  - `kCGMouseButtonLeft   = 0`
- *  - `kCGMouseButtonRight  = 1`
- *  - `kCGMouseButtonCenter = 2`
+ * `timeout:` options are measured on the warped clock, and the clock
+ * should only be warped or unwarped while nothing is running.
  *
- * And the rest are not documented! Though they should be easy enough
- * to figure out. See the `CGMouseButton` enum in the reference
- * documentation for the most up to date list.
+ * @example
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ *   Mouse.time_warp = true
+ *   Mouse.move_to [500, 500], 10 # returns right away
  *
- * @overload arbitrary_click(button)
- *   @param button [Number,#to_i]
- *   @return [CGPoint]
- * @overload arbitrary_click(button, point)
- *   @param button [Number,#to_i]
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @param enabled [Boolean]
+ * @return [Boolean]
  */
 static
 VALUE
-rb_mouse_arbitrary_click(const int argc,
-                         VALUE* const argv,
-                         UNUSED const VALUE self)
+rb_mouse_set_time_warp(UNUSED const VALUE self, const VALUE enabled)
 {
-    if (argc == 0) {
-        rb_raise(rb_eArgError, "arbitrary_click requires at least one arg");
-        return Qnil;
-    }
+    mouse_set_time_warp(RTEST(enabled));
+    return enabled;
+}
 
-    const uint_t button = NUM2UINT(argv[0]);
+static
+mouse_command_t
+rb_mouse_parse_move_to(int argc, VALUE* const argv)
+{
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
 
-    switch (argc) {
-    case 1:
-        mouse_arbitrary_click(button);
-        break;
-    case 2:
-    default:
-        mouse_arbitrary_click2(button, rb_mouse_unwrap_point(argv[1]));
-    }
+    if (!argc)
+        rb_raise(rb_eArgError, "move_to requires at least a one arg");
 
-    return CURRENT_POSITION;
+    const mouse_command_t command = {
+        .type      = kMouseCommandMoveTo,
+        .has_point = true,
+        .point     = rb_mouse_unwrap_point(argv[0]),
+        .duration  = argc > 1 ? rb_mouse_unwrap_duration(argv[1]) : DEFAULT_DURATION,
+        .fps       = options.fps,
+        .profile   = options.profile,
+        .timeout   = options.timeout,
+        .cancel    = options.cancel
+    };
+    return command;
 }
 
 /*
- * Generate a click event for the middle mouse button (down and up events)
+ * Move the mouse cursor to the given co-ordinates
  *
- * It doesn't matter if you don't have a middle mouse button.
+ * The default duration is 0.2 seconds. The animation runs at {Mouse.fps}
+ * frames per second unless the `fps:` option is given.
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * The pace of the animation follows {Mouse.profile} unless the `profile:`
+ * option is given.
  *
- * @overload middle_click()
+ * Every animated method also takes a `timeout:` option, in seconds, up
+ * to a day, and a `cancel:` option, a {Mouse::Token} that another thread can cancel.
+ * Either one stops the animation within a frame; any button held down
+ * for the operation is let go, and then {Mouse::TimeoutError} or
+ * {Mouse::CancelledError} is raised to report how far it got.
+ *
+ * @overload move_to(point, fps: Mouse.fps)
+ *   @param point [CGPoint,Array(Number,Number),#to_point]
  *   @return [CGPoint]
- * @overload middle_click(point)
- *   @param point [CGPoint]
+ * @overload move_to(point, duration, fps: Mouse.fps)
+ *   @param point [CGPoint,Array(Number,Number),#to_point]
+ *   @param duration [Number] animation time, in seconds
  *   @return [CGPoint]
+ * @raise [Mouse::TimeoutError] if the `timeout:` passes first
+ * @raise [Mouse::CancelledError] if the `cancel:` token is cancelled first
  */
 static
 VALUE
-rb_mouse_middle_click(const int argc,
-                      VALUE* const argv,
-                      UNUSED const VALUE self)
+rb_mouse_move_to(int argc,
+                 VALUE* const argv,
+                 UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_middle_click();
-        break;
-    case 1:
-    default:
-        mouse_middle_click2(rb_mouse_unwrap_point(argv[0]));
-    }
-
+    const mouse_command_t command = rb_mouse_parse_move_to(argc, argv);
+    rb_mouse_perform(&command);
     return CURRENT_POSITION;
 }
 
+static
+mouse_command_t
+rb_mouse_parse_drag_to(int argc, VALUE* const argv)
+{
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+
+    if (!argc)
+        rb_raise(rb_eArgError, "drag_to requires at least a one arg");
+
+    const mouse_command_t command = {
+        .type      = kMouseCommandDragTo,
+        .has_point = true,
+        .point     = rb_mouse_unwrap_point(argv[0]),
+        .duration  = argc > 1 ? rb_mouse_unwrap_duration(argv[1]) : DEFAULT_DURATION,
+        .fps       = options.fps,
+        .profile   = options.profile,
+        .timeout   = options.timeout,
+        .cancel    = options.cancel
+    };
+    return command;
+}
+
 /*
- * Generate a multi-click event at the current mouse position
- *
- * Unlike {Mouse.double_click} and {Mouse.triple_click} this will generate
- * a single event with the given number of clicks.
- *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * Drag the mouse cursor to the given co-ordinates
  *
- * @overload multi_click(num_clicks)
- *   @param num_clicks [Number,#to_i]
- *   @return [CGPoint]
- * @overload multi_click(num_clicks, point)
- *   @param num_clicks [Number,#to_i]
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @param (see #move_to)
+ * @return [CGPoint]
  */
 static
 VALUE
-rb_mouse_multi_click(const int argc,
-                     VALUE* const argv,
-                     UNUSED const VALUE self)
+rb_mouse_drag_to(int argc,
+                 VALUE* const argv,
+                 UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_drag_to(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+// For commands that borrow memory which must be given back with rb_ensure
+static
+VALUE
+rb_mouse_perform_ensuring(const VALUE data)
 {
+    rb_mouse_perform((const mouse_command_t*)data);
+    return Qnil;
+}
 
-    if (argc == 0) {
-        rb_raise(rb_eArgError, "multi_click requires at least one arg");
-        return Qnil;
+static
+VALUE
+rb_mouse_path_unlock(const VALUE buffer)
+{
+    rb_str_unlocktmp(buffer);
+    return Qnil;
+}
+
+static
+void
+rb_mouse_unwrap_path(mouse_command_t* const command, const void* const path, const size_t bytes)
+{
+    if (!bytes || bytes % (2 * sizeof(double)))
+        rb_raise(rb_eArgError,
+                 "a path must hold at least one x/y pair of doubles, but got %zu bytes",
+                 bytes);
+    command->path   = path;
+    command->points = bytes / (2 * sizeof(double));
+}
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+typedef struct {
+    mouse_command_t*   command;
+    rb_memory_view_t*     view;
+} rb_mouse_path_view_t;
+
+// The view is only checked once it is guarded, so that a path that does
+// not fit still gives the view back
+static
+VALUE
+rb_mouse_perform_on_view(const VALUE data)
+{
+    const rb_mouse_path_view_t* const path = (const rb_mouse_path_view_t*)data;
+    const char* const format = path->view->format;
+    if (format && strcmp(format, "d"))
+        rb_raise(rb_eArgError, "a path must hold doubles, not `%s'", format);
+    rb_mouse_unwrap_path(path->command, path->view->data, path->view->byte_size);
+    rb_mouse_perform(path->command);
+    return Qnil;
+}
+
+static
+VALUE
+rb_mouse_path_release(const VALUE data)
+{
+    rb_memory_view_release(((const rb_mouse_path_view_t*)data)->view);
+    return Qnil;
+}
+#endif
+
+// Performs `command` on the points in `path`, a packed String or a
+// memory view of doubles, which cannot change until the command is done
+static
+VALUE
+rb_mouse_perform_on_path(mouse_command_t* const command, const VALUE path)
+{
+    if (RB_TYPE_P(path, T_STRING)) {
+        rb_mouse_unwrap_path(command, RSTRING_PTR(path), RSTRING_LEN(path));
+        rb_str_locktmp(path);
+        rb_ensure(rb_mouse_perform_ensuring, (VALUE)command,
+                  rb_mouse_path_unlock, path);
+        return CURRENT_POSITION;
     }
 
-    // TODO: there has got to be a more idiomatic way to do this coercion
-    const size_t num_clicks = NUM2SIZET(argv[0]);
-
-    switch (argc) {
-    case 1:
-        mouse_multi_click(num_clicks);
-        break;
-    case 2:
-    default:
-        mouse_multi_click2(num_clicks, rb_mouse_unwrap_point(argv[1]));
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+    rb_memory_view_t view;
+    if (rb_memory_view_get(path, &view, RUBY_MEMORY_VIEW_FORMAT)) {
+        const rb_mouse_path_view_t guarded = { command, &view };
+        rb_ensure(rb_mouse_perform_on_view, (VALUE)&guarded,
+                  rb_mouse_path_release, (VALUE)&guarded);
+        return CURRENT_POSITION;
     }
+#endif
 
-    return CURRENT_POSITION;
+    rb_raise(rb_eTypeError,
+             "expected a packed String of points, not %s",
+             rb_obj_classname(path));
 }
 
 /*
- * Perform a double click at the given mouse position
+ * Move the mouse cursor along a recorded path
  *
- * Implemented by first generating a single click, and then a double click.,
- * Apps seem to respond more consistently to this behaviour since that is
- * how a human would have to generate a double click event.
+ * The path is a binary string of native endian double precision x and
+ * y co-ordinates, such as `points.flatten.pack('d*')`, or on Ruby 3.0
+ * and newer any object that exposes the same layout as a memory view.
+ * The points are read straight out of the buffer, so a path of many
+ * thousands of points costs no more to start than a short one.
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * The cursor jumps to the first point, then moves along the path at an
+ * even pace so that it reaches the last point after `duration` seconds.
+ * It takes the same `fps:`, `timeout:` and `cancel:` options as
+ * {Mouse.move_to}. The buffer cannot be changed while it is being followed.
  *
- * @overload double_click()
- *   @return [CGPoint]
- * @overload double_click(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @param path [String]
+ * @param duration [Number] animation time, in seconds
+ * @return [CGPoint]
  */
 static
 VALUE
-rb_mouse_double_click(const int argc,
-                      VALUE* const argv,
-                      UNUSED const VALUE self)
+rb_mouse_follow_path(int argc,
+                     VALUE* const argv,
+                     UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_double_click();
-        break;
-    case 1:
-    default:
-        mouse_double_click2(rb_mouse_unwrap_point(argv[0]));
-    }
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+
+    if (argc != 2)
+        rb_raise(rb_eArgError, "wrong number of arguments (%d for 2)", argc);
+
+    mouse_command_t command = {
+        .type     = kMouseCommandFollowPath,
+        .duration = rb_mouse_unwrap_duration(argv[1]),
+        .fps      = options.fps,
+        .timeout  = options.timeout,
+        .cancel   = options.cancel
+    };
+    return rb_mouse_perform_on_path(&command, argv[0]);
+}
 
-    return CURRENT_POSITION;
+static
+VALUE
+rb_mouse_replay_close(const VALUE trace)
+{
+    mouse_trace_close((mouse_trace_t*)trace);
+    return Qnil;
 }
 
 /*
- * Perform a triple click at the given mouse position
- *
- * Implemented by first generating a single click, then a double click,
- * and finally a triple click. Apps seem to respond more consistently to
- * this behaviour since that is how a human would have to generate a
- * triple click event.
+ * Post the events recorded in a trace file, each at the time it is due
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * The file is memory mapped rather than read in, so a replay starts right
+ * away and does not grow in memory however long the trace is. It takes
+ * the same `timeout:` and `cancel:` options as {Mouse.move_to}.
  *
- * @overload triple_click()
- *   @return [CGPoint]
- * @overload triple_click(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @param path [String]
+ * @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_replay(int argc,
+                VALUE* const argv,
+                UNUSED const VALUE self)
+{
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+
+    if (argc != 1)
+        rb_raise(rb_eArgError, "wrong number of arguments (%d for 1)", argc);
+
+    VALUE path = rb_get_path(argv[0]);
+    mouse_trace_t trace;
+    const int error = mouse_trace_open(&trace, StringValueCStr(path));
+    if (error == kMouseTraceInvalid)
+        rb_raise(rb_eArgError, "%s is not a mouse trace", RSTRING_PTR(path));
+    else if (error)
+        rb_syserr_fail_str(error, path);
+
+    const mouse_command_t command = {
+        .type    = kMouseCommandReplay,
+        .trace   = &trace,
+        .timeout = options.timeout,
+        .cancel  = options.cancel
+    };
+    rb_ensure(rb_mouse_perform_ensuring, (VALUE)&command,
+              rb_mouse_replay_close, (VALUE)&trace);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_scroll(int argc, VALUE* const argv)
+{
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+
+    if (argc == 0 || argc > 3)
+        rb_raise(rb_eArgError,
+                 "scroll requires 1..3 arguments, you gave %d",
+                 argc);
+
+    const mouse_command_t command = {
+        .type     = kMouseCommandScroll,
+        .amount   = NUM2INT(argv[0]),
+        .units    = argc > 1 ? rb_mouse_unwrap_units(argv[1]) : kCGScrollEventUnitLine,
+        .duration = argc > 2 ? rb_mouse_unwrap_duration(argv[2]) : DEFAULT_DURATION,
+        .fps      = options.fps,
+        .timeout  = options.timeout,
+        .cancel   = options.cancel
+    };
+    return command;
+}
+
+/*
+ * @note Scrolling by `:pixel` may not actually be by real pixels, but instead
+ *       correspond to Cocoa co-ords (I don't have a retina display, so I
+ *       haven't checked it out yet).
+ *
+ * Generate `amount` scroll events at the current cursor position
+ *
+ * Returns number of lines/pixels scrolled, default `units` are by `line`.
+ * A positive `amount` will scroll up and a negative `amount` will scroll down.
+ *
+ * An animation duration can also be specified, which defaults to 0.2 seconds,
+ * and an `fps:` option to override {Mouse.fps}.
+ *
+ * @overload scroll(amount, fps: Mouse.fps)
+ *   @param amount [Number]
+ *   @return [Number]
+ * @overload scroll(amount, units, fps: Mouse.fps)
+ *   @param amount [Number]
+ *   @param units [Symbol] `:pixel` or `:line`
+ *   @return [Number]
+ * @overload scroll(amount, units, duration, fps: Mouse.fps)
+ *   @param amount [Number]
+ *   @param units [Symbol] `:pixel` or `:line`
+ *   @param duration [Number] animation time, in seconds
+ *   @return [Number]
+ */
+static
+VALUE
+rb_mouse_scroll(int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_scroll(argc, argv);
+    rb_mouse_perform(&command);
+    return argv[0];
+}
+
+static
+mouse_command_t
+rb_mouse_parse_horizontal_scroll(int argc, VALUE* const argv)
+{
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+
+    if (argc == 0 || argc > 3)
+        rb_raise(rb_eArgError,
+                 "scroll requires 1..3 arguments, you gave %d",
+                 argc);
+
+    const mouse_command_t command = {
+        .type     = kMouseCommandHorizontalScroll,
+        .amount   = NUM2INT(argv[0]),
+        .units    = argc > 1 ? rb_mouse_unwrap_units(argv[1]) : kCGScrollEventUnitLine,
+        .duration = argc > 2 ? rb_mouse_unwrap_duration(argv[2]) : DEFAULT_DURATION,
+        .fps      = options.fps,
+        .timeout  = options.timeout,
+        .cancel   = options.cancel
+    };
+    return command;
+}
+
+/*
+ * @note Scrolling by `:pixel` may not actually be by real pixels, but instead
+ *       correspond to Cocoa co-ords (I don't have a retina display, so I haven't
+ *       checked it out yet).
+ *
+ * Generate `amount` of horizontal scroll events at the current cursor position
+ *
+ * Returns number of lines/pixels scrolled, default `units` are by `line`.
+ * A positive `amount` will scroll up and a negative `amount` will scroll down.
+ *
+ * An animation duration can also be specified, which defaults to 0.2 seconds,
+ * and an `fps:` option to override {Mouse.fps}.
+ *
+ * @overload horizontal_scroll(amount, fps: Mouse.fps)
+ *   @param amount [Number]
+ *   @return [Number]
+ * @overload horizontal_scroll(amount, units, fps: Mouse.fps)
+ *   @param amount [Number]
+ *   @param units [Symbol] `:pixel` or `:line`
+ *   @return [Number]
+ * @overload horizontal_scroll(amount, units, duration, fps: Mouse.fps)
+ *   @param amount [Number]
+ *   @param units [Symbol] `:pixel` or `:line`
+ *   @param duration [Number] animation time, in seconds
+ *   @return [Number]
+ */
+static
+VALUE
+rb_mouse_horizontal_scroll(int argc,
+                           VALUE* const argv,
+                           UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_horizontal_scroll(argc, argv);
+    rb_mouse_perform(&command);
+    return argv[0];
+}
+
+static
+mouse_command_t
+rb_mouse_parse_click_down(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandClickDown };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Generate the down click part of a click event
+ *
+ * This might be useful in concert with {Mouse.click_up} if you want
+ * to inject some behaviour between the down and up click events.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload click_down()
+ *   @return [CGPoint]
+ * @overload click_down(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_click_down(const int argc,
+                    VALUE* const argv,
+                    UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_click_down(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_click_up(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandClickUp };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Generate the up click part of a click event
+ *
+ * This might be useful in concert with {Mouse.click_down} if you want
+ * to inject some behaviour between the down and up click events.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload click_up()
+ *   @return [CGPoint]
+ * @overload click_up(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_click_up(const int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_click_up(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_click(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandClick };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Generate a regular click event (both up and down events)
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload click()
+ *   @return [CGPoint]
+ * @overload click()
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_click(const int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_click(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_secondary_click_down(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandSecondaryClickDown };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Generate the down click part of a secondary/right click event
+ *
+ * This might be useful in concert with {Mouse.secondary_click_up} if
+ * you want to inject some behaviour between the down and up click
+ * events.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload secondary_click_down()
+ *   @return [CGPoint]
+ * @overload secondary_click_down(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_secondary_click_down(const int argc,
+                              VALUE* const argv,
+                              UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_secondary_click_down(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_secondary_click_up(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandSecondaryClickUp };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Generate the up click part of a secondary/right click event
+ *
+ * This might be useful in concert with {Mouse.secondary_click_down} if
+ * you want to inject some behaviour between the down and up click events.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload secondary_click_up()
+ *   @return [CGPoint]
+ * @overload secondary_click_up(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_secondary_click_up(const int argc,
+                            VALUE* const argv,
+                            UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_secondary_click_up(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_secondary_click(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandSecondaryClick };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Generate a secondary click (both down and up events)
+ *
+ * Secondary click is often referred to as "right click".
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload secondary_click()
+ *   @return [CGPoint]
+ * @overload secondary_click(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_secondary_click(const int argc,
+                         VALUE* const argv,
+                         UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_secondary_click(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_arbitrary_click_down(int argc, VALUE* const argv)
+{
+    if (argc == 0)
+        rb_raise(rb_eArgError, "arbitrary_click_down requires at least one arg");
+
+    mouse_command_t command = {
+        .type   = kMouseCommandArbitraryClickDown,
+        .button = NUM2UINT(argv[0])
+    };
+    if (argc > 1)
+        rb_mouse_unwrap_command_point(&command, argv[1]);
+    return command;
+}
+
+/*
+ * Generate the down click part of an arbitrary click event
+ *
+ * This might be useful in concert with {Mouse.arbitrary_click_up} if
+ * you want to inject some behaviour between the down and up click
+ * events.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload arbitrary_click_down()
+ *   @return [CGPoint]
+ * @overload arbitrary_click_down(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_arbitrary_click_down(const int argc,
+                              VALUE* const argv,
+                              UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_arbitrary_click_down(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_arbitrary_click_up(int argc, VALUE* const argv)
+{
+    if (argc == 0)
+        rb_raise(rb_eArgError, "arbitrary_click_up requires at least one arg");
+
+    mouse_command_t command = {
+        .type   = kMouseCommandArbitraryClickUp,
+        .button = NUM2UINT(argv[0])
+    };
+    if (argc > 1)
+        rb_mouse_unwrap_command_point(&command, argv[1]);
+    return command;
+}
+
+/*
+ * Generate the up click part of an arbitrary click event
+ *
+ * This might be useful in concert with {Mouse.arbitrary_click_down} if
+ * you want to inject some behaviour between the down and up click events.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload arbitrary_click_up()
+ *   @return [CGPoint]
+ * @overload arbitrary_click_up(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_arbitrary_click_up(const int argc,
+                            VALUE* const argv,
+                            UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_arbitrary_click_up(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_arbitrary_click(int argc, VALUE* const argv)
+{
+    if (argc == 0)
+        rb_raise(rb_eArgError, "arbitrary_click requires at least one arg");
+
+    mouse_command_t command = {
+        .type   = kMouseCommandArbitraryClick,
+        .button = NUM2UINT(argv[0])
+    };
+    if (argc > 1)
+        rb_mouse_unwrap_command_point(&command, argv[1]);
+    return command;
+}
+
+/*
+ * Generate a click using an arbitrary mouse button (down and up events)
+ *
+ * Numbers are used to map the mouse buttons. At the time of writing,
+ * the documented values are:
+ *
+ *  - `kCGMouseButtonLeft   = 0`
+ *  - `kCGMouseButtonRight  = 1`
+ *  - `kCGMouseButtonCenter = 2`
+ *
+ * And the rest are not documented! Though they should be easy enough
+ * to figure out. See the `CGMouseButton` enum in the reference
+ * documentation for the most up to date list.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload arbitrary_click(button)
+ *   @param button [Number,#to_i]
+ *   @return [CGPoint]
+ * @overload arbitrary_click(button, point)
+ *   @param button [Number,#to_i]
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_arbitrary_click(const int argc,
+                         VALUE* const argv,
+                         UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_arbitrary_click(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_middle_click(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandMiddleClick };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Generate a click event for the middle mouse button (down and up events)
+ *
+ * It doesn't matter if you don't have a middle mouse button.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload middle_click()
+ *   @return [CGPoint]
+ * @overload middle_click(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_middle_click(const int argc,
+                      VALUE* const argv,
+                      UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_middle_click(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_multi_click(int argc, VALUE* const argv)
+{
+    if (argc == 0)
+        rb_raise(rb_eArgError, "multi_click requires at least one arg");
+
+    // TODO: there has got to be a more idiomatic way to do this coercion
+    mouse_command_t command = {
+        .type   = kMouseCommandMultiClick,
+        .clicks = NUM2SIZET(argv[0])
+    };
+    if (argc > 1)
+        rb_mouse_unwrap_command_point(&command, argv[1]);
+    return command;
+}
+
+/*
+ * Generate a multi-click event at the current mouse position
+ *
+ * Unlike {Mouse.double_click} and {Mouse.triple_click} this will generate
+ * a single event with the given number of clicks.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload multi_click(num_clicks)
+ *   @param num_clicks [Number,#to_i]
+ *   @return [CGPoint]
+ * @overload multi_click(num_clicks, point)
+ *   @param num_clicks [Number,#to_i]
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_multi_click(const int argc,
+                     VALUE* const argv,
+                     UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_multi_click(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_double_click(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandDoubleClick };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Perform a double click at the given mouse position
+ *
+ * Implemented by first generating a single click, and then a double click.,
+ * Apps seem to respond more consistently to this behaviour since that is
+ * how a human would have to generate a double click event.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload double_click()
+ *   @return [CGPoint]
+ * @overload double_click(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_double_click(const int argc,
+                      VALUE* const argv,
+                      UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_double_click(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_triple_click(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandTripleClick };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Perform a triple click at the given mouse position
+ *
+ * Implemented by first generating a single click, then a double click,
+ * and finally a triple click. Apps seem to respond more consistently to
+ * this behaviour since that is how a human would have to generate a
+ * triple click event.
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload triple_click()
+ *   @return [CGPoint]
+ * @overload triple_click(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_triple_click(const int argc,
+                      VALUE* const argv,
+                      UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_triple_click(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+CGEventMouseSubtype
+rb_mouse_unwrap_button(const VALUE button)
+{
+    if (button == sym_left)
+        return kCGMouseButtonLeft;
+    if (button == sym_right)
+        return kCGMouseButtonRight;
+    if (button == sym_middle)
+        return kCGMouseButtonCenter;
+    if (SYMBOL_P(button))
+        rb_raise(rb_eArgError, "unknown button `%s'", rb_id2name(SYM2ID(button)));
+    return NUM2UINT(button);
+}
+
+static
+double
+rb_mouse_unwrap_seconds(const VALUE hash, const VALUE key, const double fallback)
+{
+    const VALUE seconds = rb_hash_delete(hash, key);
+    if (NIL_P(seconds))
+        return fallback;
+
+    const double value = NUM2DBL(seconds);
+    if (!(value >= 0 && isfinite(value)))
+        rb_raise(rb_eArgError,
+                 "%s must be a finite number of seconds, at least 0, you gave %g",
+                 rb_id2name(SYM2ID(key)), value);
+    return value;
+}
+
+/*
+ * Click on each of a list of points, one after the other
+ *
+ * The points are packed like a path for {Mouse.follow_path}, such as
+ * `points.flatten.pack('d*')`, and are all clicked from one native loop
+ * without going back to Ruby between clicks. The cursor jumps to each
+ * point, holds the button down for `hold:` seconds and waits
+ * `interval:` seconds after letting go before the next click; both
+ * default to a single frame at {Mouse.fps}, rather than the tenth of a
+ * second that {Mouse.click} holds for.
+ *
+ * Clicking the same point twice within the system's double click time
+ * may be seen as a double click, so use a longer `interval:` if that
+ * matters. It also takes the `timeout:` and `cancel:` options of
+ * {Mouse.move_to}, which stop it between clicks.
+ *
+ * @example
+ *
+ *   boxes = (0...10).map { |row| [40, 100 + (row * 20)] }
+ *   Mouse.click_all boxes.flatten.pack('d*')
+ *   Mouse.click_all boxes.flatten.pack('d*'), button: :right, interval: 0.5
+ *
+ * @param points [String]
+ * @option opts [Symbol,Integer] :button (:left) `:left`, `:right`,
+ *   `:middle` or a button number
+ * @option opts [Number] :hold seconds each button is held down
+ * @option opts [Number] :interval seconds between clicks
+ * @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_click_all(int argc,
+                   VALUE* const argv,
+                   UNUSED const VALUE self)
+{
+    const double frame = 1 / mouse_fps();
+    mouse_command_t command = {
+        .type     = kMouseCommandClickAll,
+        .button   = kCGMouseButtonLeft,
+        .hold     = frame,
+        .interval = frame
+    };
+
+    // take out the options only this method has before the common ones
+    // are checked
+    if (argc && RB_TYPE_P(argv[argc - 1], T_HASH)) {
+        const VALUE hash = rb_hash_dup(argv[argc - 1]);
+        const VALUE button = rb_hash_delete(hash, sym_button);
+        if (!NIL_P(button))
+            command.button = rb_mouse_unwrap_button(button);
+        command.hold     = rb_mouse_unwrap_seconds(hash, sym_hold, frame);
+        command.interval = rb_mouse_unwrap_seconds(hash, sym_interval, frame);
+        argv[argc - 1] = hash;
+    }
+
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+    if (argc != 1)
+        rb_raise(rb_eArgError, "wrong number of arguments (%d for 1)", argc);
+
+    command.timeout = options.timeout;
+    command.cancel  = options.cancel;
+    return rb_mouse_perform_on_path(&command, argv[0]);
+}
+
+
+/* @!group Gestures */
+
+static
+mouse_command_t
+rb_mouse_parse_smart_magnify(int argc, VALUE* const argv)
+{
+    mouse_command_t command = { .type = kMouseCommandSmartMagnify };
+    if (argc)
+        rb_mouse_unwrap_command_point(&command, argv[0]);
+    return command;
+}
+
+/*
+ * Perform a smart magnify (double tap on trackpad)
+ *
+ * You can optionally specify a point to click; the mouse cursor will
+ * instantly jump to the given point; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * @overload smart_magnify()
+ *   @return [CGPoint]
+ * @overload smart_magnify(point)
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_smart_magnify(const int argc,
+                       VALUE* const argv,
+                       UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_smart_magnify(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_swipe(int argc, VALUE* const argv)
+{
+    if (!argc)
+        rb_raise(rb_eArgError, "wrong number of arguments (0 for 1+)");
+
+    const VALUE direction_input = argv[0];
+    CGSwipeDirection direction = kCGSwipeDirectionNone;
+    if (direction_input == sym_up)
+        direction = kCGSwipeDirectionUp;
+    else if (direction_input == sym_down)
+        direction = kCGSwipeDirectionDown;
+    else if (direction_input == sym_left)
+        direction = kCGSwipeDirectionLeft;
+    else if (direction_input == sym_right)
+        direction = kCGSwipeDirectionRight;
+    else
+        rb_raise(rb_eArgError,
+                 "invalid swipe direction `%s'",
+                 rb_id2name(SYM2ID(direction_input)));
+
+    mouse_command_t command = {
+        .type      = kMouseCommandSwipe,
+        .direction = direction
+    };
+    if (argc > 1)
+        rb_mouse_unwrap_command_point(&command, argv[1]);
+    return command;
+}
+
+/*
+ * Perform a swipe gesture in the given `direction`
+ *
+ * You can optionally specify a point on screen for the mouse
+ * pointer to be moved to before the gesture begins. The movement will
+ * be instantaneous; otherwise the click event happens
+ * at the current cursor position.
+ *
+ * You can also optionally specify the duration of the swipe event;
+ * the default `duration` is 0.2 seconds.
+ *
+ * @overload swipe(direction)
+ *   @param direction [Symbol]
+ *   @return [CGPoint]
+ * @overload swipe(direction, point)
+ *   @param direction [Symbol]
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ * @overload swipe(direction, point, duration)
+ *   @param direction [Symbol]
+ *   @param point [CGPoint]
+ *   @param duration [Float]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_swipe(const int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_swipe(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_pinch(int argc, VALUE* const argv)
+{
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+
+    if (!argc)
+        rb_raise(rb_eArgError, "wrong number of arguments (%d for 1+)", argc);
+
+    const VALUE input_direction = argv[0];
+    CGPinchDirection  direction = kCGPinchNone;
+
+    if (input_direction == sym_expand || input_direction == sym_zoom)
+        direction = kCGPinchExpand;
+    else if (input_direction == sym_contract || input_direction == sym_unzoom)
+        direction = kCGPinchContract;
+    else
+        rb_raise(rb_eArgError,
+                 "invalid pinch direction `%s'",
+                 rb_id2name(SYM2ID(input_direction)));
+
+    mouse_command_t command = {
+        .type      = kMouseCommandPinch,
+        .direction = direction,
+        .magnitude = argc > 1 ? NUM2DBL(argv[1]) : DEFAULT_MAGNIFICATION,
+        .duration  = argc > 3 ? rb_mouse_unwrap_duration(argv[3]) : DEFAULT_DURATION,
+        .fps       = options.fps,
+        .timeout   = options.timeout,
+        .cancel    = options.cancel
+    };
+    if (argc > 2)
+        rb_mouse_unwrap_command_point(&command, argv[2]);
+    return command;
+}
+
+/*
+ * Perform a pinch gesture in given `direction`
+ *
+ * You can optionally specify the `magnification` factor and/or
+ * `duration` for the pinch event.
+ *
+ * Available pinch directions are:
+ *
+ *   - `:zoom` or `:expand`
+ *   - `:unzoom` or `:contract`
+ *
+ * Magnification is a relative magnification setting. A zoom value of
+ * `1.0` means `1.0` more than the current zoom level. `2.0` would be
+ * `2.0` levels higher than the current zoom. Default is `1.0`.
+ *
+ * You can also optionally specify a point on screen for the mouse
+ * pointer to be moved to before the gesture begins. The movement will
+ * be instantaneous. Default `point` is {#current_position}.
+ *
+ * An animation duration can also be specified. The default is 0.2 seconds.
+ * The animation runs at {Mouse.fps} unless the `fps:` option is given.
+ *
+ * @overload pinch(direction)
+ *   @param direction [Symbol]
+ *   @return [CGPoint]
+ * @overload pinch(direction, magnification)
+ *   @param direction [Symbol]
+ *   @param magnification [Float]
+ *   @return [CGPoint]
+ * @overload pinch(direction, magnification, point)
+ *   @param direction [Symbol]
+ *   @param magnification [Float]
+ *   @param point [CGPoint,#to_point]
+ *   @return [CGPoint]
+ * @overload pinch(direction, magnification, point, duration, fps: Mouse.fps)
+ *   @param direction [Symbol]
+ *   @param magnification [Float]
+ *   @param point [CGPoint,#to_point]
+ *   @param duration [Float]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_pinch(int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_pinch(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+static
+mouse_command_t
+rb_mouse_parse_rotate(int argc, VALUE* const argv)
+{
+    const rb_mouse_options_t options = rb_mouse_unwrap_options(&argc, argv);
+
+    if (argc < 2)
+        rb_raise(rb_eArgError, "wrong number of arguments (%d for 2+)", argc);
+
+
+    const VALUE input_dir = argv[0];
+    CGRotateDirection direction = kCGRotateNone;
+
+    if      (input_dir == sym_cw ||
+             input_dir == sym_clockwise ||
+             input_dir == sym_clock_wise)
+        direction = kCGRotateClockwise;
+
+    else if (input_dir == sym_ccw ||
+             input_dir == sym_counter_clockwise ||
+             input_dir == sym_counter_clock_wise)
+        direction = kCGRotateCounterClockwise;
+    else
+        rb_raise(rb_eArgError,
+                 "invalid rotation direction `%s'",
+                 rb_id2name(SYM2ID(input_dir)));
+
+    mouse_command_t command = {
+        .type      = kMouseCommandRotate,
+        .direction = direction,
+        .magnitude = NUM2DBL(argv[1]),
+        .duration  = argc > 3 ? rb_mouse_unwrap_duration(argv[3]) : DEFAULT_DURATION,
+        .fps       = options.fps,
+        .timeout   = options.timeout,
+        .cancel    = options.cancel
+    };
+    if (argc > 2)
+        rb_mouse_unwrap_command_point(&command, argv[2]);
+    return command;
+}
+
+/*
+ * Perform a rotation gesture in the given `direction` the given `angle` degrees
+ *
+ * Possible directions are:
+ *
+ *   - `:cw`, ':clockwise`, ':clock_wise` to rotate in the clockwise
+ *     direction
+ *   - `:ccw`, ':counter_clockwise`, `:counter_clock_wise` to rotate in
+ *     the the counter clockwise direction
+ *
+ * The `angle` parameter is a number of degrees to rotate. There are 360
+ * degrees in a full rotation, as you would expect in Euclidian geometry.
+ *
+ * You can also optionally specify a point on screen for the mouse
+ * pointer to be moved to before the gesture begins. The movement will
+ * be instantaneous. Default `point` is {#current_position}.
+ *
+ * An animation duration can also be specified. The default is 0.2 seconds.
+ * The animation runs at {Mouse.fps} unless the `fps:` option is given.
+ *
+ * @overload rotate(direction, angle)
+ *   @param direction [Symbol]
+ *   @param angle [Float]
+ *   @return [CGPoint]
+ * @overload rotate(direction, angle, point)
+ *   @param direction [Symbol]
+ *   @param angle [Float]
+ *   @param point [CGPoint]
+ *   @return [CGPoint]
+ * @overload rotate(direction, angle, point, duration, fps: Mouse.fps)
+ *   @param direction [Symbol]
+ *   @param angle [Float]
+ *   @param point [CGPoint]
+ *   @param duration [Float]
+ *   @return [CGPoint]
+ */
+static
+VALUE
+rb_mouse_rotate(int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    const mouse_command_t command = rb_mouse_parse_rotate(argc, argv);
+    rb_mouse_perform(&command);
+    return CURRENT_POSITION;
+}
+
+/* @!endgroup */
+
+
+typedef mouse_command_t (*rb_mouse_parser_t)(int argc, VALUE* const argv);
+
+typedef struct {
+    const char*   name;
+    rb_mouse_parser_t parse;
+    ID                id;
+    ID          async_id;
+} rb_mouse_operation_t;
+
+static rb_mouse_operation_t rb_mouse_operations[] = {
+    { "move_to",              rb_mouse_parse_move_to,              0, 0 },
+    { "drag_to",              rb_mouse_parse_drag_to,              0, 0 },
+    { "scroll",               rb_mouse_parse_scroll,               0, 0 },
+    { "horizontal_scroll",    rb_mouse_parse_horizontal_scroll,    0, 0 },
+    { "click_down",           rb_mouse_parse_click_down,           0, 0 },
+    { "click_up",             rb_mouse_parse_click_up,             0, 0 },
+    { "click",                rb_mouse_parse_click,                0, 0 },
+    { "secondary_click_down", rb_mouse_parse_secondary_click_down, 0, 0 },
+    { "secondary_click_up",   rb_mouse_parse_secondary_click_up,   0, 0 },
+    { "secondary_click",      rb_mouse_parse_secondary_click,      0, 0 },
+    { "middle_click",         rb_mouse_parse_middle_click,         0, 0 },
+    { "arbitrary_click_down", rb_mouse_parse_arbitrary_click_down, 0, 0 },
+    { "arbitrary_click_up",   rb_mouse_parse_arbitrary_click_up,   0, 0 },
+    { "arbitrary_click",      rb_mouse_parse_arbitrary_click,      0, 0 },
+    { "multi_click",          rb_mouse_parse_multi_click,          0, 0 },
+    { "double_click",         rb_mouse_parse_double_click,         0, 0 },
+    { "triple_click",         rb_mouse_parse_triple_click,         0, 0 },
+    { "smart_magnify",        rb_mouse_parse_smart_magnify,        0, 0 },
+    { "swipe",                rb_mouse_parse_swipe,                0, 0 },
+    { "pinch",                rb_mouse_parse_pinch,                0, 0 },
+    { "rotate",               rb_mouse_parse_rotate,               0, 0 },
+};
+
+#define OPERATIONS (sizeof(rb_mouse_operations) / sizeof(rb_mouse_operation_t))
+
+
+static
+void
+rb_mouse_handle_free(void* const job)
+{
+    mouse_job_release(job);
+}
+
+static const rb_data_type_t rb_mouse_handle_type = {
+    .wrap_struct_name = "Mouse::Handle",
+    .function = {
+        .dfree = rb_mouse_handle_free
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static
+mouse_job_t*
+rb_mouse_handle_job(const VALUE self)
+{
+    return rb_check_typeddata(self, &rb_mouse_handle_type);
+}
+
+/*
+ * Start a mouse operation on a background thread and return right away
+ *
+ * Every method in {Mouse} that posts events has an asynchronous
+ * variant with an `_async` suffix, which takes the same arguments,
+ * except for {Mouse.follow_path}, {Mouse.click_all} and {Mouse.replay},
+ * which read their points or trace straight out of a buffer that is only
+ * held for as long as the call.
+ *
+ * For example, `Mouse.move_to_async([100, 100], 2)` starts moving the
+ * cursor and returns a {Mouse::Handle} that can be used to wait for the
+ * move to finish, or to cancel it.
+ *
+ * Operations on a device are performed one at a time by a thread of its
+ * own, in the order that they were started, whether they were started
+ * this way or called directly from any Ruby thread; so their events never
+ * interleave. A `timeout:` starts counting down once the operation
+ * starts, rather than when it was queued.
+ *
+ * @return [Mouse::Handle]
+ */
+static
+VALUE
+rb_mouse_async(const int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    const ID name = rb_frame_this_func();
+
+    for (size_t i = 0; i < OPERATIONS; i++) {
+        if (rb_mouse_operations[i].async_id != name)
+            continue;
+
+        const mouse_command_t command = rb_mouse_operations[i].parse(argc, argv);
+        if (command.cancel)
+            rb_raise(rb_eArgError,
+                     "%s does not take a cancel token, use Mouse::Handle#cancel",
+                     rb_id2name(name));
+
+        mouse_job_t* const job = mouse_dispatch(&command);
+        if (!job)
+            rb_memerror();
+        return TypedData_Wrap_Struct(rb_cHandle, &rb_mouse_handle_type, job);
+    }
+
+    rb_raise(rb_eNotImpError, "no asynchronous %s", rb_id2name(name));
+}
+
+
+/*
+ * Work out what a mouse operation would do, without posting anything
+ *
+ * Takes the name of one of the {Mouse} methods that post events and the
+ * arguments it would be called with. Returns how long the operation
+ * should take, which can be added up to budget how long a script will
+ * run, and for {Mouse.move_to} and {Mouse.drag_to} the position of the
+ * cursor at each frame, starting from where the cursor is now.
+ *
+ * Plans for moves and drags are cached by distance, duration, frame
+ * rate and motion profile, so later moves over the same distance reuse
+ * the plan; `:cached` says whether the plan was already made.
+ *
+ * @example
+ *
+ *   Mouse.plan :move_to, [100, 100], 0.2
+ *   # => { duration: 0.2, cached: false, frames: [#<CGPoint ...>, ...] }
+ *   Mouse.plan :click
+ *   # => { duration: 0.1, cached: false, frames: [] }
+ *
+ * @param name [Symbol]
+ * @return [Hash{Symbol=>Object}]
+ */
+static
+VALUE
+rb_mouse_plan(const int argc, VALUE* const argv, UNUSED const VALUE self)
+{
+    if (!argc)
+        rb_raise(rb_eArgError, "wrong number of arguments (0 for 1+)");
+
+    const ID name = rb_to_id(argv[0]);
+
+    for (size_t i = 0; i < OPERATIONS; i++) {
+        if (rb_mouse_operations[i].id != name)
+            continue;
+
+        const mouse_command_t command = rb_mouse_operations[i].parse(argc - 1, argv + 1);
+        const VALUE frames = rb_ary_new();
+        bool cached = false;
+
+        if (command.type == kMouseCommandMoveTo || command.type == kMouseCommandDragTo) {
+            const CGPoint start = mouse_current_position();
+            const CGPoint delta = CGPointMake(command.point.x - start.x,
+                                              command.point.y - start.y);
+            mouse_plan_t* const plan =
+                mouse_plan_get(delta, command.duration, command.fps, command.profile, &cached);
+            if (!plan)
+                rb_memerror();
+
+            for (size_t frame = 1; frame <= plan->steps; frame++)
+                rb_ary_push(frames, rb_mouse_wrap_point(CGPointMake(start.x + plan->offsets[frame].x,
+                                                                    start.y + plan->offsets[frame].y)));
+            mouse_plan_release(plan);
+        }
+
+        const VALUE result = rb_hash_new();
+        rb_hash_aset(result, sym_duration, DBL2NUM(mouse_command_wall_time(&command)));
+        rb_hash_aset(result, sym_cached,   cached ? Qtrue : Qfalse);
+        rb_hash_aset(result, sym_frames,   frames);
+        return result;
+    }
+
+    rb_raise(rb_eArgError, "cannot plan %s", rb_id2name(name));
+}
+
+typedef struct {
+    mouse_command_t* commands;
+    size_t              count;
+    size_t           capacity;
+    VALUE              tokens; // keeps the cancel tokens of commands alive
+    bool              running;
+} rb_mouse_batch_t;
+
+static
+void
+rb_mouse_batch_mark(void* const data)
+{
+    const rb_mouse_batch_t* const batch = data;
+    rb_gc_mark(batch->tokens);
+}
+
+static
+void
+rb_mouse_batch_free(void* const data)
+{
+    rb_mouse_batch_t* const batch = data;
+    xfree(batch->commands);
+    xfree(batch);
+}
+
+static
+size_t
+rb_mouse_batch_size(const void* const data)
+{
+    const rb_mouse_batch_t* const batch = data;
+    return sizeof(rb_mouse_batch_t) + (batch->capacity * sizeof(mouse_command_t));
+}
+
+static const rb_data_type_t rb_mouse_batch_type = {
+    .wrap_struct_name = "Mouse::Batch",
+    .function = {
+        .dmark = rb_mouse_batch_mark,
+        .dfree = rb_mouse_batch_free,
+        .dsize = rb_mouse_batch_size
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static
+VALUE
+rb_mouse_batch_alloc(const VALUE klass)
+{
+    rb_mouse_batch_t* batch;
+    const VALUE self = TypedData_Make_Struct(klass,
+                                             rb_mouse_batch_t,
+                                             &rb_mouse_batch_type,
+                                             batch);
+    batch->tokens = rb_ary_new();
+    return self;
+}
+
+// The command list cannot change while it is being performed, since it
+// is read without holding the GVL
+static
+rb_mouse_batch_t*
+rb_mouse_batch_unwrap(const VALUE self)
+{
+    rb_mouse_batch_t* const batch = rb_check_typeddata(self, &rb_mouse_batch_type);
+    if (batch->running)
+        rb_raise(rb_eRuntimeError, "cannot change a batch while it is running");
+    return batch;
+}
+
+/*
+ * Add an operation to the end of the batch
+ *
+ * A batch responds to the same methods as {Mouse} that post events, such
+ * as `#move_to` and `#click`, with the same arguments. The arguments are
+ * checked when the operation is added, but nothing is posted until the
+ * batch is run.
+ *
+ * @return [Mouse::Batch]
+ */
+static
+VALUE
+rb_mouse_batch_record(const int argc, VALUE* const argv, const VALUE self)
+{
+    rb_mouse_batch_t* const batch = rb_mouse_batch_unwrap(self);
+    const ID name = rb_frame_this_func();
+
+    for (size_t i = 0; i < OPERATIONS; i++) {
+        if (rb_mouse_operations[i].id != name)
+            continue;
+
+        const mouse_command_t command = rb_mouse_operations[i].parse(argc, argv);
+        if (command.cancel)
+            rb_ary_push(batch->tokens, rb_hash_aref(argv[argc - 1], sym_cancel));
+
+        if (batch->count == batch->capacity) {
+            batch->capacity = batch->capacity ? batch->capacity * 2 : 16;
+            REALLOC_N(batch->commands, mouse_command_t, batch->capacity);
+        }
+        batch->commands[batch->count++] = command;
+        return self;
+    }
+
+    rb_raise(rb_eNotImpError, "no batched %s", rb_id2name(name));
+}
+
+/*
+ * The number of operations in the batch
+ *
+ * @return [Integer]
+ */
+static
+VALUE
+rb_mouse_batch_length(const VALUE self)
+{
+    const rb_mouse_batch_t* const batch = rb_check_typeddata(self, &rb_mouse_batch_type);
+    return SIZET2NUM(batch->count);
+}
+
+/*
+ * Remove every operation from the batch
+ *
+ * @return [Mouse::Batch]
+ */
+static
+VALUE
+rb_mouse_batch_clear(const VALUE self)
+{
+    rb_mouse_batch_t* const batch = rb_mouse_batch_unwrap(self);
+    batch->count = 0;
+    rb_ary_clear(batch->tokens);
+    return self;
+}
+
+static
+VALUE
+rb_mouse_batch_perform(const VALUE self)
+{
+    const rb_mouse_batch_t* const batch = rb_check_typeddata(self, &rb_mouse_batch_type);
+    rb_mouse_perform_list(batch->commands, batch->count);
+    return Qnil;
+}
+
+static
+VALUE
+rb_mouse_batch_finish(const VALUE self)
+{
+    rb_mouse_batch_t* const batch = rb_check_typeddata(self, &rb_mouse_batch_type);
+    batch->running = false;
+    return Qnil;
+}
+
+/*
+ * Perform every operation in the batch, in order
+ *
+ * The whole batch is performed in one go without going back to Ruby
+ * between operations. A batch can be run more than once.
+ *
+ * @return [CGPoint] the cursor position once the batch is done
+ */
+static
+VALUE
+rb_mouse_batch_run(const VALUE self)
+{
+    rb_mouse_batch_unwrap(self)->running = true;
+    rb_ensure(rb_mouse_batch_perform, self, rb_mouse_batch_finish, self);
+    return CURRENT_POSITION;
+}
+
+/*
+ * Record the operations made in the block and then perform all of them
+ *
+ * The block is given a {Mouse::Batch} to record operations into:
+ *
+ *     Mouse.batch do |b|
+ *       b.move_to [100, 100]
+ *       b.click
+ *       b.drag_to [400, 300], 0.5
+ *     end
+ *
+ * This saves the cost of going back and forth between Ruby and the
+ * extension for each operation, which adds up for long scripts of
+ * short operations.
+ *
+ * @yieldparam batch [Mouse::Batch]
+ * @return [CGPoint] the cursor position once the batch is done
+ */
+static
+VALUE
+rb_mouse_batch(UNUSED const VALUE self)
+{
+    rb_need_block();
+    const VALUE batch = rb_class_new_instance(0, NULL, rb_cBatch);
+    rb_yield(batch);
+    return rb_mouse_batch_run(batch);
+}
+
+static
+void*
+rb_mouse_handle_wait_without_gvl(void* const job)
+{
+    mouse_job_wait(job);
+    return NULL;
+}
+
+static
+void
+rb_mouse_handle_interrupt(UNUSED void* const data)
+{
+    mouse_dispatch_interrupt();
+}
+
+/*
+ * Block until the operation is finished, or has been cancelled
+ *
+ * Other Ruby threads keep running while this waits.
+ *
+ * @return [CGPoint] the cursor position when the operation finished
+ */
+static
+VALUE
+rb_mouse_handle_wait(const VALUE self)
+{
+    mouse_job_t* const job = rb_mouse_handle_job(self);
+
+    while (!mouse_job_done(job)) {
+        rb_thread_call_without_gvl(rb_mouse_handle_wait_without_gvl,
+                                   job,
+                                   rb_mouse_handle_interrupt,
+                                   NULL);
+        rb_thread_check_ints();
+    }
+
+    return rb_mouse_wrap_point(mouse_job_position(job));
+}
+
+/*
+ * Whether the operation has finished, either normally or by being cancelled
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_handle_is_done(const VALUE self)
+{
+    return mouse_job_done(rb_mouse_handle_job(self)) ? Qtrue : Qfalse;
+}
+
+/*
+ * Whether the operation was cancelled before it finished
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_handle_is_cancelled(const VALUE self)
+{
+    const mouse_job_state_t state = mouse_job_state(rb_mouse_handle_job(self));
+    return state == kMouseJobCancelled ? Qtrue : Qfalse;
+}
+
+/*
+ * Whether the operation was stopped by its `timeout:` before it finished
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_handle_is_timed_out(const VALUE self)
+{
+    const mouse_job_state_t state = mouse_job_state(rb_mouse_handle_job(self));
+    return state == kMouseJobTimedOut ? Qtrue : Qfalse;
+}
+
+/*
+ * How much of the operation's animation was posted, from 0.0 to 1.0
+ *
+ * @return [Float,nil] `nil` until the operation is done
+ */
+static
+VALUE
+rb_mouse_handle_progress(const VALUE self)
+{
+    mouse_job_t* const job = rb_mouse_handle_job(self);
+    if (!mouse_job_done(job))
+        return Qnil;
+    return DBL2NUM(mouse_job_progress(job));
+}
+
+/*
+ * Cancel the operation
+ *
+ * An operation that has not started yet will be skipped, and one that
+ * is in progress will stop at its next frame; an operation that has
+ * already finished is not affected.
+ *
+ * @return [Mouse::Handle]
+ */
+static
+VALUE
+rb_mouse_handle_cancel(const VALUE self)
+{
+    mouse_job_cancel(rb_mouse_handle_job(self));
+    return self;
+}
+
+/*
+ * The cursor position when the operation finished
+ *
+ * @return [CGPoint,nil] `nil` until the operation is done
+ */
+static
+VALUE
+rb_mouse_handle_position(const VALUE self)
+{
+    mouse_job_t* const job = rb_mouse_handle_job(self);
+    if (!mouse_job_done(job))
+        return Qnil;
+    return rb_mouse_wrap_point(mouse_job_position(job));
+}
+
+static
+VALUE
+rb_mouse_token_alloc(const VALUE klass)
+{
+    mouse_token_t* token;
+    return TypedData_Make_Struct(klass, mouse_token_t, &rb_mouse_token_type, token);
+}
+
+/*
+ * Stop every operation that was given this token
+ *
+ * Operations stop within a frame and raise {Mouse::CancelledError};
+ * operations given the token after it was cancelled stop right away.
+ *
+ * @return [Mouse::Token]
+ */
+static
+VALUE
+rb_mouse_token_cancel(const VALUE self)
+{
+    mouse_token_cancel(rb_mouse_unwrap_token(self));
+    return self;
+}
+
+/*
+ * Whether the token has been cancelled
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_token_is_cancelled(const VALUE self)
+{
+    return mouse_token_cancelled(rb_mouse_unwrap_token(self)) ? Qtrue : Qfalse;
+}
+
+
+/*
+ * The recorder of events posted by the library
+ *
+ * @return [Mouse::Recorder]
+ */
+static
+VALUE
+rb_mouse_recorder(UNUSED const VALUE self)
+{
+    return rb_mRecorder;
+}
+
+/*
+ * Start keeping a copy of every event that the library posts
+ *
+ * Recording does not change how long it takes to post events, so it
+ * can be left on for a whole test run.
+ *
+ * @return [Mouse::Recorder]
+ */
+static
+VALUE
+rb_mouse_recorder_start(const VALUE self)
+{
+    mouse_recorder_start();
+    return self;
+}
+
+/*
+ * Stop recording events; events already recorded can still be drained
+ *
+ * @return [Mouse::Recorder]
+ */
+static
+VALUE
+rb_mouse_recorder_stop(const VALUE self)
+{
+    mouse_recorder_stop();
+    return self;
+}
+
+/*
+ * Whether events are being recorded
+ *
+ * @return [Boolean]
+ */
+static
+VALUE
+rb_mouse_recorder_is_recording(UNUSED const VALUE self)
+{
+    return MOUSE_RECORDING ? Qtrue : Qfalse;
+}
+
+static
+VALUE
+rb_mouse_recorder_wrap_record(const mouse_trace_record_t* const record)
+{
+    return rb_struct_new(rb_cRecorderEvent,
+                         ULL2NUM(record->timestamp),
+                         UINT2NUM(record->type),
+                         UINT2NUM(record->button),
+                         UINT2NUM(record->click_state),
+                         UINT2NUM(record->scroll_units),
+                         DBL2NUM(record->x),
+                         DBL2NUM(record->y),
+                         INT2NUM(record->scroll_vertical),
+                         INT2NUM(record->scroll_horizontal),
+                         UINT2NUM(record->gesture_type),
+                         UINT2NUM(record->gesture_phase),
+                         UINT2NUM(record->swipe_direction),
+                         UINT2NUM(record->swipe_motion),
+                         DBL2NUM(record->gesture_value),
+                         DBL2NUM(record->swipe_position));
+}
+
+/*
+ * Take every recorded event out of the recorder, oldest first
+ *
+ * The recorder holds the last 65536 events that have not been drained
+ * or flushed; events posted while it is full are dropped and counted.
+ *
+ * @return [Array<Mouse::Recorder::Event>]
+ */
+static
+VALUE
+rb_mouse_recorder_drain(UNUSED const VALUE self)
+{
+    const VALUE events = rb_ary_new();
+    mouse_trace_record_t records[256];
+    size_t count;
+
+    while ((count = mouse_recorder_drain(records, 256)))
+        for (size_t i = 0; i < count; i++)
+            rb_ary_push(events, rb_mouse_recorder_wrap_record(&records[i]));
+
+    return events;
+}
+
+/*
+ * How many events were dropped because the recorder was full
+ *
+ * @return [Integer]
+ */
+static
+VALUE
+rb_mouse_recorder_dropped(UNUSED const VALUE self)
+{
+    return SIZET2NUM(mouse_recorder_dropped());
+}
+
+/*
+ * Write recorded events to a trace file from a background thread
+ *
+ * Events are appended to the trace a few milliseconds after they are
+ * posted, until {Mouse::Recorder.stop_flushing} is called. The trace
+ * can be replayed with {Mouse.replay}.
+ *
+ * @param path [String]
+ * @return [Mouse::Recorder]
+ */
+static
+VALUE
+rb_mouse_recorder_flush_to(const VALUE self, VALUE path)
+{
+    path = rb_get_path(path);
+    const int error = mouse_recorder_flush_to(StringValueCStr(path));
+    if (error)
+        rb_syserr_fail_str(error, path);
+    return self;
+}
+
+/*
+ * Write out any events still in the recorder and close the trace file
+ *
+ * @return [Mouse::Recorder]
+ */
+static
+VALUE
+rb_mouse_recorder_stop_flushing(const VALUE self)
+{
+    mouse_recorder_stop_flushing();
+    return self;
+}
+
+// Devices on other backends look at the default device's screen, which
+// nothing posts to unless the default device is on the memory backend
+static
+mouse_memory_t*
+rb_mouse_memory()
+{
+    mouse_memory_t* const memory = mouse_memory();
+    return memory ? memory : &mouse_memory_default;
+}
+
+/*
+ * The size of the virtual screen of the `memory` backend
+ *
+ * @return [Array(Integer,Integer)] width and height
+ */
+static
+VALUE
+rb_mouse_memory_screen(UNUSED const VALUE self)
+{
+    const CGPoint size = mouse_memory_screen(rb_mouse_memory());
+    return rb_ary_new3(2, DBL2NUM(size.x), DBL2NUM(size.y));
+}
+
+/*
+ * Change the size of the virtual screen of the `memory` backend
+ *
+ * The cursor is moved back onto the screen if it is no longer on it.
+ *
+ * @example
+ *
+ *   Mouse::Memory.screen = [2560, 1440]
+ *
+ * @param size [Array(Number,Number)] width and height
+ * @return [Array(Number,Number)]
+ */
+static
+VALUE
+rb_mouse_memory_set_screen(UNUSED const VALUE self, const VALUE size)
+{
+    const VALUE pair = rb_Array(size);
+    if (RARRAY_LEN(pair) != 2)
+        rb_raise(rb_eArgError, "screen size must be a width and a height");
+    mouse_memory_set_screen(rb_mouse_memory(),
+                            CGPointMake(NUM2DBL(rb_ary_entry(pair, 0)),
+                                        NUM2DBL(rb_ary_entry(pair, 1))));
+    return size;
+}
+
+/*
+ * The buttons held down on the `memory` backend
+ *
+ * @example
+ *
+ *   Mouse.click_down
+ *   Mouse::Memory.buttons # => [0]
+ *
+ * @return [Array<Integer>]
  */
 static
 VALUE
-rb_mouse_triple_click(const int argc,
-                      VALUE* const argv,
-                      UNUSED const VALUE self)
+rb_mouse_memory_buttons(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_triple_click();
-        break;
-    case 1:
-    default:
-        mouse_triple_click2(rb_mouse_unwrap_point(argv[0]));
-    }
-
-    return CURRENT_POSITION;
+    const uint32_t buttons = mouse_memory_buttons(rb_mouse_memory());
+    const VALUE pressed = rb_ary_new();
+    for (unsigned int button = 0; button < 32; button++)
+        if (buttons & (1u << button))
+            rb_ary_push(pressed, UINT2NUM(button));
+    return pressed;
 }
 
-
-/* @!group Gestures */
-
 /*
- * Perform a smart magnify (double tap on trackpad)
+ * The events posted to the `memory` backend since it was last cleared,
+ * oldest first
  *
- * You can optionally specify a point to click; the mouse cursor will
- * instantly jump to the given point; otherwise the click event happens
- * at the current cursor position.
+ * Only the last 4096 events are kept.
  *
- * @overload smart_magnify()
- *   @return [CGPoint]
- * @overload smart_magnify(point)
- *   @param point [CGPoint]
- *   @return [CGPoint]
+ * @return [Array<Mouse::Recorder::Event>]
  */
 static
 VALUE
-rb_mouse_smart_magnify(const int argc,
-                       VALUE* const argv,
-                       UNUSED const VALUE self)
+rb_mouse_memory_events(UNUSED const VALUE self)
 {
-    switch (argc) {
-    case 0:
-        mouse_smart_magnify();
-        break;
-    case 1:
-    default:
-        mouse_smart_magnify2(rb_mouse_unwrap_point(argv[0]));
+    mouse_event_t* const events = ALLOC_N(mouse_event_t, MOUSE_MEMORY_EVENTS);
+    const size_t count = mouse_memory_events(rb_mouse_memory(), events, MOUSE_MEMORY_EVENTS);
+
+    const VALUE ary = rb_ary_new();
+    for (size_t i = 0; i < count; i++) {
+        const mouse_trace_record_t record = mouse_event_record(&events[i]);
+        rb_ary_push(ary, rb_mouse_recorder_wrap_record(&record));
     }
 
-    return CURRENT_POSITION;
+    xfree(events);
+    return ary;
 }
 
 /*
- * Perform a swipe gesture in the given `direction`
- *
- * You can optionally specify a point on screen for the mouse
- * pointer to be moved to before the gesture begins. The movement will
- * be instantaneous; otherwise the click event happens
- * at the current cursor position.
+ * Forget the events posted to the `memory` backend, and let go of
+ * every button
  *
- * You can also optionally specify the duration of the swipe event;
- * the default `duration` is 0.2 seconds.
+ * The cursor stays where it is.
  *
- * @overload swipe(direction)
- *   @param direction [Symbol]
- *   @return [CGPoint]
- * @overload swipe(direction, point)
- *   @param direction [Symbol]
- *   @param point [CGPoint]
- *   @return [CGPoint]
- * @overload swipe(direction, point, duration)
- *   @param direction [Symbol]
- *   @param point [CGPoint]
- *   @param duration [Float]
- *   @return [CGPoint]
+ * @return [Mouse::Memory]
  */
 static
 VALUE
-rb_mouse_swipe(const int argc, VALUE* const argv, UNUSED const VALUE self)
+rb_mouse_memory_clear(const VALUE self)
 {
-    if (!argc)
-        rb_raise(rb_eArgError, "wrong number of arguments (0 for 1+)");
+    mouse_memory_clear(rb_mouse_memory());
+    return self;
+}
 
-    const VALUE direction_input = argv[0];
-    CGSwipeDirection direction = kCGSwipeDirectionNone;
-    if (direction_input == sym_up)
-        direction = kCGSwipeDirectionUp;
-    else if (direction_input == sym_down)
-        direction = kCGSwipeDirectionDown;
-    else if (direction_input == sym_left)
-        direction = kCGSwipeDirectionLeft;
-    else if (direction_input == sym_right)
-        direction = kCGSwipeDirectionRight;
-    else
-        rb_raise(rb_eArgError,
-                 "invalid swipe direction `%s'",
-                 rb_id2name(SYM2ID(direction_input)));
+static
+void
+rb_mouse_device_free(void* const device)
+{
+    if (device)
+        mouse_device_release(device);
+}
 
-    if (argc == 1) {
-      mouse_swipe(direction);
-      return CURRENT_POSITION;
-    }
+static const rb_data_type_t rb_mouse_device_type = {
+    .wrap_struct_name = "Mouse::Device",
+    .function = {
+        .dfree = rb_mouse_device_free
+    },
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY
+};
 
-    const CGPoint point = rb_mouse_unwrap_point(argv[1]);
-    mouse_swipe2(direction, point);
-    return CURRENT_POSITION;
+static
+mouse_device_t*
+rb_mouse_device_unwrap(const VALUE self)
+{
+    mouse_device_t* const device = rb_check_typeddata(self, &rb_mouse_device_type);
+    if (!device)
+        rb_raise(rb_eRuntimeError, "uninitialized mouse device");
+    return device;
+}
+
+static
+VALUE
+rb_mouse_device_alloc(const VALUE klass)
+{
+    return TypedData_Wrap_Struct(klass, &rb_mouse_device_type, NULL);
 }
 
 /*
- * Perform a pinch gesture in given `direction`
- *
- * You can optionally specify the `magnification` factor and/or
- * `duration` for the pinch event.
- *
- * Available pinch directions are:
- *
- *   - `:zoom` or `:expand`
- *   - `:unzoom` or `:contract`
- *
- * Magnification is a relative magnification setting. A zoom value of
- * `1.0` means `1.0` more than the current zoom level. `2.0` would be
- * `2.0` levels higher than the current zoom. Default is `1.0`.
- *
- * You can also optionally specify a point on screen for the mouse
- * pointer to be moved to before the gesture begins. The movement will
- * be instantaneous. Default `point` is {#current_position}.
- *
- * An animation duration can also be specified. The default is 0.2 seconds.
- *
- * @overload pinch(direction)
- *   @param direction [Symbol]
- *   @return [CGPoint]
- * @overload pinch(direction, magnification)
- *   @param direction [Symbol]
- *   @param magnification [Float]
- *   @return [CGPoint]
- * @overload pinch(direction, magnification, point)
- *   @param direction [Symbol]
- *   @param magnification [Float]
- *   @param point [CGPoint,#to_point]
- *   @return [CGPoint]
- * @overload pinch(direction, magnification, point, duration)
- *   @param direction [Symbol]
- *   @param magnification [Float]
- *   @param point [CGPoint,#to_point]
- *   @param duration [Float]
- *   @return [CGPoint]
+ * Open a new pointer device
+ *
+ * Each device has its own instance of a backend, such as its own
+ * virtual pointer on `uinput` or its own screen on `memory`, and its
+ * own frame rate, motion profile, clock and {Mouse.stats}. A device
+ * responds to every method of {Mouse}, which then works on that device
+ * alone, so different threads can each drive a device of their own
+ * without waiting on each other.
+ *
+ * The options set up the device as the {Mouse} setters of the same name
+ * would; the backend defaults to the one {Mouse.backend} names.
+ *
+ * @example
+ *
+ *   left  = Mouse::Device.new(backend: 'memory', fps: 60)
+ *   right = Mouse::Device.new(backend: 'memory', profile: :minimum_jerk)
+ *   [Thread.new { left.move_to [100, 100] },
+ *    Thread.new { right.move_to [500, 100] }].each(&:join)
+ *
+ * @param options [Hash]
+ * @option options [String,Symbol] :backend
+ * @option options [Number] :fps
+ * @option options [Symbol] :profile
+ * @option options [Boolean] :dead_reckoning
+ * @option options [Boolean] :time_warp
+ * @option options [Boolean] :coalesce
  */
 static
 VALUE
-rb_mouse_pinch(const int argc, VALUE* const argv, UNUSED const VALUE self)
+rb_mouse_device_initialize(const int argc, VALUE* const argv, const VALUE self)
 {
-    if (!argc)
-        rb_raise(rb_eArgError, "wrong number of arguments (%d for 1+)", argc);
+    if (DATA_PTR(self))
+        rb_raise(rb_eRuntimeError, "mouse device already initialized");
+
+    VALUE options;
+    rb_scan_args(argc, argv, "01", &options);
+    if (NIL_P(options))
+        options = rb_hash_new();
+    Check_Type(options, T_HASH);
+
+    size_t consumed = 0;
+    const mouse_backend_t* backend = mouse_backend();
+    double          fps            = mouse_fps();
+    mouse_profile_t profile        = mouse_profile();
+    bool            dead_reckoning = false;
+    bool            time_warp      = false;
+    bool            coalesce       = true;
+
+    const VALUE name = rb_hash_lookup2(options, sym_backend, Qundef);
+    if (name != Qundef) {
+        VALUE string = rb_obj_as_string(name);
+        backend = mouse_backend_find(StringValueCStr(string));
+        if (!backend)
+            rb_raise(rb_eArgError, "unknown mouse backend `%s'", RSTRING_PTR(string));
+        consumed++;
+    }
 
-    const VALUE input_direction = argv[0];
-    CGPinchDirection  direction = kCGPinchNone;
+    const VALUE maybe_fps = rb_hash_lookup2(options, sym_fps, Qundef);
+    if (maybe_fps != Qundef) {
+        fps = rb_mouse_unwrap_fps(maybe_fps);
+        consumed++;
+    }
 
-    if (input_direction == sym_expand || input_direction == sym_zoom)
-        direction = kCGPinchExpand;
-    else if (input_direction == sym_contract || input_direction == sym_unzoom)
-        direction = kCGPinchContract;
-    else
-        rb_raise(rb_eArgError,
-                 "invalid pinch direction `%s'",
-                 rb_id2name(SYM2ID(input_direction)));
+    const VALUE maybe_profile = rb_hash_lookup2(options, sym_profile, Qundef);
+    if (maybe_profile != Qundef) {
+        profile = rb_mouse_unwrap_profile(maybe_profile);
+        consumed++;
+    }
 
-    if (argc == 1) {
-        mouse_pinch(direction);
-        return CURRENT_POSITION;
+    const VALUE maybe_dead_reckoning = rb_hash_lookup2(options, sym_dead_reckoning, Qundef);
+    if (maybe_dead_reckoning != Qundef) {
+        dead_reckoning = RTEST(maybe_dead_reckoning);
+        consumed++;
     }
 
-    const double magnification = NUM2DBL(argv[1]);
-    if (argc == 2) {
-        mouse_pinch2(direction, magnification);
-        return CURRENT_POSITION;
+    const VALUE maybe_time_warp = rb_hash_lookup2(options, sym_time_warp, Qundef);
+    if (maybe_time_warp != Qundef) {
+        time_warp = RTEST(maybe_time_warp);
+        consumed++;
     }
 
-    const CGPoint point = rb_mouse_unwrap_point(argv[2]);
-    if (argc == 3) {
-        mouse_pinch3(direction, magnification, point);
-        return CURRENT_POSITION;
+    const VALUE maybe_coalesce = rb_hash_lookup2(options, sym_coalesce, Qundef);
+    if (maybe_coalesce != Qundef) {
+        coalesce = RTEST(maybe_coalesce);
+        consumed++;
     }
 
-    const double duration = NUM2DBL(argv[3]);
-    mouse_pinch4(direction, magnification, point, duration);
-    return CURRENT_POSITION;
+    if ((size_t)RHASH_SIZE(options) != consumed)
+        rb_raise(rb_eArgError,
+                 "unknown keyword in %s",
+                 RSTRING_PTR(rb_inspect(options)));
+
+    mouse_device_t* const device = mouse_device_new(backend);
+    if (!device)
+        rb_raise(rb_eRuntimeError, "could not open the %s mouse backend", backend->name);
+    DATA_PTR(self) = device;
+
+    mouse_device_t* const previous = mouse_set_device(device);
+    mouse_set_fps(fps);
+    mouse_set_profile(profile);
+    mouse_set_dead_reckoning(dead_reckoning);
+    mouse_set_time_warp(time_warp);
+    mouse_set_coalesce(coalesce);
+    mouse_set_device(previous);
+
+    return self;
+}
+
+typedef struct {
+    mouse_device_t* device;
+    mouse_device_t* previous;
+    int             argc;
+    const VALUE*    argv;
+    ID              name;
+} rb_mouse_device_call_t;
+
+static
+VALUE
+rb_mouse_device_send(const VALUE data)
+{
+    const rb_mouse_device_call_t* const call = (const rb_mouse_device_call_t*)data;
+    return rb_funcall_passing_block(rb_mMouse, call->name, call->argc, call->argv);
+}
+
+static
+VALUE
+rb_mouse_device_yield(const VALUE self)
+{
+    return rb_yield(self);
+}
+
+static
+VALUE
+rb_mouse_device_restore(const VALUE data)
+{
+    const rb_mouse_device_call_t* const call = (const rb_mouse_device_call_t*)data;
+    mouse_set_device(call->previous);
+    return Qnil;
+}
+
+// Every method of Mouse is defined on Device as a call to the same method
+// on Mouse with the device installed on the calling thread, which is all
+// it takes for the method to work on the device instead
+static
+VALUE
+rb_mouse_device_forward(const int argc, VALUE* const argv, const VALUE self)
+{
+    rb_mouse_device_call_t call = {
+        .device = rb_mouse_device_unwrap(self),
+        .argc   = argc,
+        .argv   = argv,
+        .name   = rb_frame_this_func()
+    };
+    call.previous = mouse_set_device(call.device);
+    return rb_ensure(rb_mouse_device_send,    (VALUE)&call,
+                     rb_mouse_device_restore, (VALUE)&call);
 }
 
 /*
- * Perform a rotation gesture in the given `direction` the given `angle` degrees
- *
- * Possible directions are:
- *
- *   - `:cw`, ':clockwise`, ':clock_wise` to rotate in the clockwise
- *     direction
- *   - `:ccw`, ':counter_clockwise`, `:counter_clock_wise` to rotate in
- *     the the counter clockwise direction
+ * Make this the device that {Mouse} works on, for the length of the block
  *
- * The `angle` parameter is a number of degrees to rotate. There are 360
- * degrees in a full rotation, as you would expect in Euclidian geometry.
+ * Only the calling thread is affected, and code in the block that calls
+ * {Mouse} methods, or records and runs a {Mouse::Batch}, posts to this
+ * device; so does {Mouse::Memory}.
  *
- * You can also optionally specify a point on screen for the mouse
- * pointer to be moved to before the gesture begins. The movement will
- * be instantaneous. Default `point` is {#current_position}.
+ * @example
  *
- * An animation duration can also be specified. The default is 0.2 seconds.
+ *   device.use do
+ *     Mouse.click [10, 10]
+ *     Mouse::Memory.events.size # => 2
+ *   end
  *
- * @overload rotate(direction, angle)
- *   @param direction [Symbol]
- *   @param angle [Float]
- *   @return [CGPoint]
- * @overload rotate(direction, angle, point)
- *   @param direction [Symbol]
- *   @param angle [Float]
- *   @param point [CGPoint]
- *   @return [CGPoint]
- * @overload rotate(direction, angle, point, duration)
- *   @param direction [Symbol]
- *   @param angle [Float]
- *   @param point [CGPoint]
- *   @param duration [Float]
- *   @return [CGPoint]
+ * @yieldparam device [Mouse::Device]
+ * @return the value of the block
  */
 static
 VALUE
-rb_mouse_rotate(const int argc, VALUE* const argv, UNUSED const VALUE self)
+rb_mouse_device_use(const VALUE self)
 {
-    if (argc < 2)
-        rb_raise(rb_eArgError, "wrong number of arguments (%d for 2+)", argc);
-
-
-    const VALUE input_dir = argv[0];
-    CGRotateDirection direction = kCGRotateNone;
-
-    if      (input_dir == sym_cw ||
-             input_dir == sym_clockwise ||
-             input_dir == sym_clock_wise)
-        direction = kCGRotateClockwise;
-
-    else if (input_dir == sym_ccw ||
-             input_dir == sym_counter_clockwise ||
-             input_dir == sym_counter_clock_wise)
-        direction = kCGRotateCounterClockwise;
-    else
-        rb_raise(rb_eArgError,
-                 "invalid rotation direction `%s'",
-                 rb_id2name(SYM2ID(input_dir)));
-
-    const double angle = NUM2DBL(argv[1]);
-
-    if (argc == 2) {
-        mouse_rotate(direction, angle);
-        return CURRENT_POSITION;
-    }
-
-    const CGPoint point = rb_mouse_unwrap_point(argv[2]);
-    if (argc == 3) {
-        mouse_rotate2(direction, angle, point);
-        return CURRENT_POSITION;
-    }
-
-    mouse_rotate3(direction, angle, point, NUM2DBL(argv[3]));
-    return CURRENT_POSITION;
+    rb_need_block();
+    rb_mouse_device_call_t call = { .device = rb_mouse_device_unwrap(self) };
+    call.previous = mouse_set_device(call.device);
+    return rb_ensure(rb_mouse_device_yield,   self,
+                     rb_mouse_device_restore, (VALUE)&call);
 }
 
-/* @!endgroup */
-
-
 void Init_mouse(void);
 
 void
@@ -972,6 +2964,36 @@ Init_mouse()
     sel_to_point = rb_intern("to_point");
     sel_new      = rb_intern("new");
 
+    sym_created  = ID2SYM(rb_intern("created"));
+    sym_dropped  = ID2SYM(rb_intern("dropped"));
+    sym_posted   = ID2SYM(rb_intern("posted"));
+    sym_fps      = ID2SYM(rb_intern("fps"));
+    sym_timeout  = ID2SYM(rb_intern("timeout"));
+    sym_cancel   = ID2SYM(rb_intern("cancel"));
+    sym_profile  = ID2SYM(rb_intern("profile"));
+    sym_frames   = ID2SYM(rb_intern("frames"));
+    sym_duration = ID2SYM(rb_intern("duration"));
+    sym_cached   = ID2SYM(rb_intern("cached"));
+
+    sym_lateness       = ID2SYM(rb_intern("lateness"));
+    sym_operations     = ID2SYM(rb_intern("operations"));
+    sym_count          = ID2SYM(rb_intern("count"));
+    sym_mean           = ID2SYM(rb_intern("mean"));
+    sym_max            = ID2SYM(rb_intern("max"));
+    sym_p50            = ID2SYM(rb_intern("p50"));
+    sym_p90            = ID2SYM(rb_intern("p90"));
+    sym_p99            = ID2SYM(rb_intern("p99"));
+    sym_p999           = ID2SYM(rb_intern("p999"));
+    sym_histogram      = ID2SYM(rb_intern("histogram"));
+    sym_frames_planned = ID2SYM(rb_intern("frames_planned"));
+    sym_frames_posted  = ID2SYM(rb_intern("frames_posted"));
+    sym_frames_coalesced = ID2SYM(rb_intern("frames_coalesced"));
+
+    sym_linear       = ID2SYM(rb_intern("linear"));
+    sym_ease_in_out  = ID2SYM(rb_intern("ease_in_out"));
+    sym_minimum_jerk = ID2SYM(rb_intern("minimum_jerk"));
+    sym_s_curve      = ID2SYM(rb_intern("s_curve"));
+
     sym_pixel    = ID2SYM(rb_intern("pixel"));
     sym_line     = ID2SYM(rb_intern("line"));
 
@@ -979,6 +3001,16 @@ Init_mouse()
     sym_down     = ID2SYM(rb_intern("down"));
     sym_left     = ID2SYM(rb_intern("left"));
     sym_right    = ID2SYM(rb_intern("right"));
+    sym_middle   = ID2SYM(rb_intern("middle"));
+
+    sym_button   = ID2SYM(rb_intern("button"));
+    sym_hold     = ID2SYM(rb_intern("hold"));
+    sym_interval = ID2SYM(rb_intern("interval"));
+
+    sym_backend        = ID2SYM(rb_intern("backend"));
+    sym_dead_reckoning = ID2SYM(rb_intern("dead_reckoning"));
+    sym_time_warp      = ID2SYM(rb_intern("time_warp"));
+    sym_coalesce       = ID2SYM(rb_intern("coalesce"));
 
     sym_zoom     = ID2SYM(rb_intern("zoom"));
     sym_unzoom   = ID2SYM(rb_intern("unzoom"));
@@ -992,6 +3024,15 @@ Init_mouse()
     sym_counter_clockwise  = ID2SYM(rb_intern("counter_clockwise"));
     sym_counter_clock_wise = ID2SYM(rb_intern("counter_clock_wise"));
 
+    const char* const backend_name = getenv("MOUSE_BACKEND");
+    if (backend_name && *backend_name) {
+        const mouse_backend_t* const backend = mouse_backend_find(backend_name);
+        if (!backend)
+            rb_raise(rb_eArgError, "unknown mouse backend `%s'", backend_name);
+        if (!mouse_set_backend(backend))
+            rb_raise(rb_eRuntimeError, "could not open the %s mouse backend", backend_name);
+    }
+
     /*
      * Document-module: Mouse
      *
@@ -1012,8 +3053,27 @@ Init_mouse()
     rb_extend_object(rb_mMouse, rb_mMouse);
 
     rb_define_method(rb_mMouse, "current_position",     rb_mouse_current_position,      0);
+    rb_define_method(rb_mMouse, "backend",              rb_mouse_backend,               0);
+    rb_define_method(rb_mMouse, "event_counts",         rb_mouse_event_counts,          0);
+    rb_define_method(rb_mMouse, "fps",                  rb_mouse_fps,                   0);
+    rb_define_method(rb_mMouse, "fps=",                 rb_mouse_set_fps,               1);
+    rb_define_method(rb_mMouse, "profile",              rb_mouse_profile,               0);
+    rb_define_method(rb_mMouse, "profile=",             rb_mouse_set_profile,           1);
+    rb_define_method(rb_mMouse, "dead_reckoning?",      rb_mouse_dead_reckoning,        0);
+    rb_define_method(rb_mMouse, "dead_reckoning=",      rb_mouse_set_dead_reckoning,    1);
+    rb_define_method(rb_mMouse, "time_warp?",           rb_mouse_time_warp,             0);
+    rb_define_method(rb_mMouse, "time_warp=",           rb_mouse_set_time_warp,         1);
+    rb_define_method(rb_mMouse, "coalesce?",            rb_mouse_coalesce,              0);
+    rb_define_method(rb_mMouse, "coalesce=",            rb_mouse_set_coalesce,          1);
+    rb_define_method(rb_mMouse, "batch",                rb_mouse_batch,                 0);
+    rb_define_method(rb_mMouse, "recorder",             rb_mouse_recorder,              0);
+    rb_define_method(rb_mMouse, "plan",                 rb_mouse_plan,                 -1);
+    rb_define_method(rb_mMouse, "stats",                rb_mouse_stats,                 0);
+    rb_define_method(rb_mMouse, "reset_stats",          rb_mouse_reset_stats,           0);
     rb_define_method(rb_mMouse, "move_to",              rb_mouse_move_to,              -1);
     rb_define_method(rb_mMouse, "drag_to",              rb_mouse_drag_to,              -1);
+    rb_define_method(rb_mMouse, "follow_path",          rb_mouse_follow_path,          -1);
+    rb_define_method(rb_mMouse, "replay",               rb_mouse_replay,               -1);
     rb_define_method(rb_mMouse, "scroll",               rb_mouse_scroll,               -1);
     rb_define_method(rb_mMouse, "horizontal_scroll",    rb_mouse_horizontal_scroll,    -1);
     rb_define_method(rb_mMouse, "click_down",           rb_mouse_click_down,           -1);
@@ -1029,6 +3089,7 @@ Init_mouse()
     rb_define_method(rb_mMouse, "multi_click",          rb_mouse_multi_click,          -1);
     rb_define_method(rb_mMouse, "double_click",         rb_mouse_double_click,         -1);
     rb_define_method(rb_mMouse, "triple_click",         rb_mouse_triple_click,         -1);
+    rb_define_method(rb_mMouse, "click_all",            rb_mouse_click_all,            -1);
 
     rb_define_method(rb_mMouse, "smart_magnify",        rb_mouse_smart_magnify,        -1);
     rb_define_method(rb_mMouse, "swipe",                rb_mouse_swipe,                -1);
@@ -1040,4 +3101,144 @@ Init_mouse()
     rb_define_alias(rb_mMouse, "right_click_up",        "secondary_click_up");
     rb_define_alias(rb_mMouse, "right_click",           "secondary_click");
     rb_define_alias(rb_mMouse, "two_finger_double_tap", "smart_magnify");
+
+    for (size_t i = 0; i < OPERATIONS; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s_async", rb_mouse_operations[i].name);
+        rb_mouse_operations[i].id       = rb_intern(rb_mouse_operations[i].name);
+        rb_mouse_operations[i].async_id = rb_intern(name);
+        rb_define_method(rb_mMouse, name, rb_mouse_async, -1);
+    }
+
+    /*
+     * Document-class: Mouse::Handle
+     *
+     * A handle on a mouse operation started by one of the `_async`
+     * variants of the {Mouse} methods, such as `Mouse.move_to_async`.
+     */
+    rb_cHandle = rb_define_class_under(rb_mMouse, "Handle", rb_cObject);
+    rb_undef_alloc_func(rb_cHandle);
+    rb_define_method(rb_cHandle, "wait",       rb_mouse_handle_wait,         0);
+    rb_define_method(rb_cHandle, "done?",      rb_mouse_handle_is_done,      0);
+    rb_define_method(rb_cHandle, "cancelled?", rb_mouse_handle_is_cancelled, 0);
+    rb_define_method(rb_cHandle, "timed_out?", rb_mouse_handle_is_timed_out, 0);
+    rb_define_method(rb_cHandle, "cancel",     rb_mouse_handle_cancel,       0);
+    rb_define_method(rb_cHandle, "position",   rb_mouse_handle_position,     0);
+    rb_define_method(rb_cHandle, "progress",   rb_mouse_handle_progress,     0);
+
+    /*
+     * Document-class: Mouse::Token
+     *
+     * A token that can be passed to animated {Mouse} methods with the
+     * `cancel:` option, and cancelled from another thread to stop them.
+     */
+    rb_cToken = rb_define_class_under(rb_mMouse, "Token", rb_cObject);
+    rb_define_alloc_func(rb_cToken, rb_mouse_token_alloc);
+    rb_define_method(rb_cToken, "cancel",     rb_mouse_token_cancel,       0);
+    rb_define_method(rb_cToken, "cancelled?", rb_mouse_token_is_cancelled, 0);
+
+    /*
+     * Document-class: Mouse::CancelledError
+     *
+     * Raised when an animated {Mouse} method is stopped by its `cancel:`
+     * token before it finished. `#progress` is how much of the animation
+     * was posted, from 0.0 to 1.0, and `#position` is where the cursor
+     * was left.
+     */
+    rb_eCancelled = rb_define_class_under(rb_mMouse, "CancelledError", rb_eStandardError);
+    rb_define_attr(rb_eCancelled, "progress", 1, 0);
+    rb_define_attr(rb_eCancelled, "position", 1, 0);
+
+    /*
+     * Document-class: Mouse::TimeoutError
+     *
+     * Raised when an animated {Mouse} method is stopped by its `timeout:`
+     * before it finished.
+     */
+    rb_eTimeout = rb_define_class_under(rb_mMouse, "TimeoutError", rb_eCancelled);
+
+    /*
+     * Document-class: Mouse::Batch
+     *
+     * A list of mouse operations that can be performed in one go;
+     * see {Mouse.batch}.
+     */
+    rb_cBatch = rb_define_class_under(rb_mMouse, "Batch", rb_cObject);
+    rb_define_alloc_func(rb_cBatch, rb_mouse_batch_alloc);
+    rb_define_method(rb_cBatch, "run",    rb_mouse_batch_run,    0);
+    rb_define_method(rb_cBatch, "length", rb_mouse_batch_length, 0);
+    rb_define_method(rb_cBatch, "clear",  rb_mouse_batch_clear,  0);
+    rb_define_alias(rb_cBatch,  "size",   "length");
+    for (size_t i = 0; i < OPERATIONS; i++)
+        rb_define_method(rb_cBatch, rb_mouse_operations[i].name, rb_mouse_batch_record, -1);
+    rb_define_alias(rb_cBatch,  "hscroll",               "horizontal_scroll");
+    rb_define_alias(rb_cBatch,  "right_click_down",      "secondary_click_down");
+    rb_define_alias(rb_cBatch,  "right_click_up",        "secondary_click_up");
+    rb_define_alias(rb_cBatch,  "right_click",           "secondary_click");
+    rb_define_alias(rb_cBatch,  "two_finger_double_tap", "smart_magnify");
+
+    /*
+     * Document-module: Mouse::Recorder
+     *
+     * Keeps a copy of every event posted by the library, so that the
+     * exact event stream of a failed test can be looked at afterwards.
+     * See {Mouse.recorder}.
+     */
+    rb_mRecorder = rb_define_module_under(rb_mMouse, "Recorder");
+    rb_define_module_function(rb_mRecorder, "start",         rb_mouse_recorder_start,         0);
+    rb_define_module_function(rb_mRecorder, "stop",          rb_mouse_recorder_stop,          0);
+    rb_define_module_function(rb_mRecorder, "recording?",    rb_mouse_recorder_is_recording,  0);
+    rb_define_module_function(rb_mRecorder, "drain",         rb_mouse_recorder_drain,         0);
+    rb_define_module_function(rb_mRecorder, "dropped",       rb_mouse_recorder_dropped,       0);
+    rb_define_module_function(rb_mRecorder, "flush_to",      rb_mouse_recorder_flush_to,      1);
+    rb_define_module_function(rb_mRecorder, "stop_flushing", rb_mouse_recorder_stop_flushing, 0);
+
+    /*
+     * Document-class: Mouse::Recorder::Event
+     *
+     * An event posted while recording. Fields hold the raw values that
+     * were set on the event, such as a `CGEventType` in `type`, and are
+     * zero when they do not apply to the type of event.
+     */
+    rb_cRecorderEvent = rb_struct_define_under(rb_mRecorder, "Event",
+                                               "timestamp", "type", "button",
+                                               "click_state", "scroll_units",
+                                               "x", "y",
+                                               "scroll_vertical", "scroll_horizontal",
+                                               "gesture_type", "gesture_phase",
+                                               "swipe_direction", "swipe_motion",
+                                               "gesture_value", "swipe_position",
+                                               NULL);
+
+    /*
+     * Document-module: Mouse::Memory
+     *
+     * The virtual screen of the `memory` backend, which has a cursor,
+     * buttons and a log of events but no window server behind it. The
+     * cursor stays on the screen, so moving off it stops at the edge.
+     * The methods work whichever backend is in use, but only the
+     * `memory` backend changes what they return.
+     */
+    rb_mMemory = rb_define_module_under(rb_mMouse, "Memory");
+    rb_define_module_function(rb_mMemory, "screen",  rb_mouse_memory_screen,     0);
+    rb_define_module_function(rb_mMemory, "screen=", rb_mouse_memory_set_screen, 1);
+    rb_define_module_function(rb_mMemory, "buttons", rb_mouse_memory_buttons,    0);
+    rb_define_module_function(rb_mMemory, "events",  rb_mouse_memory_events,     0);
+    rb_define_module_function(rb_mMemory, "clear",   rb_mouse_memory_clear,      0);
+
+    /*
+     * Document-class: Mouse::Device
+     *
+     * A pointer of its own, with its own backend instance, settings and
+     * statistics; see {Mouse::Device#initialize}.
+     */
+    rb_cDevice = rb_define_class_under(rb_mMouse, "Device", rb_cObject);
+    rb_include_module(rb_cDevice, rb_mMouse);
+    rb_define_alloc_func(rb_cDevice, rb_mouse_device_alloc);
+    rb_define_method(rb_cDevice, "initialize", rb_mouse_device_initialize, -1);
+    rb_define_method(rb_cDevice, "use",        rb_mouse_device_use,         0);
+
+    const VALUE methods = rb_class_instance_methods(0, NULL, rb_mMouse);
+    for (long i = 0; i < RARRAY_LEN(methods); i++)
+        rb_define_method_id(rb_cDevice, SYM2ID(RARRAY_AREF(methods, i)), rb_mouse_device_forward, -1);
 }
@@ -7,97 +7,746 @@
 //
 
 #include "mouser.h"
+#include "plan.h"
+#include "probes.h"
+#include "recorder.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <errno.h>
+#include <time.h>
+#endif
+
+// Everything that one device keeps to itself. Threads post through the
+// device installed on them, which is the default device until another
+// is installed, so the functions below that do not take a device all
+// work on the current thread's one.
+struct mouse_device {
+    const mouse_backend_t* backend;
+    void*                  state;          // as opened by the backend
+    double                 frame_rate;
+    bool                   dead_reckoning;
+    bool                   time_warp;
+    bool                   coalesce;
+    uint64_t               warped_now;     // what mouse_now() returns while time_warp is set
+    mouse_profile_t        profile;
+    mouse_event_counts_t   event_counts;
+    mouse_stats_t          stats;
+    size_t                 references;
+    void*                  attachment;     // see mouse_device_attach()
+    void                 (*detach)(void* const attachment);
+};
+
+static mouse_device_t default_device = {
+#ifdef __APPLE__
+    .backend    = &mouse_cg_backend,
+    .state      = NULL,
+#else
+    .backend    = &mouse_memory_backend,
+    .state      = &mouse_memory_default,
+#endif
+    .frame_rate = DEFAULT_FPS,
+    .profile    = kMouseProfileLinear,
+    .coalesce   = true,
+    .references = 1
+};
+
+static __thread mouse_device_t* device = &default_device;
+
+static __thread mouse_token_t* token = NULL;
+
+#if defined(MOUSE_USDT) && defined(_SDT_HAS_SEMAPHORES)
+MOUSE_SEMAPHORES(MOUSE_DEFINE_SEMAPHORE);
+#endif
+
+// Operations made of other operations, like a click made of a click down
+// and a click up, are only counted once, as the outermost operation
+static __thread uint_t   operation_depth  = 0;
+static __thread uint64_t frames_planned   = 0;
+static __thread uint64_t frames_posted    = 0;
+static __thread uint64_t frames_coalesced = 0;
+
+#define COUNT(counter) __atomic_fetch_add(&device->event_counts.counter, 1, __ATOMIC_RELAXED)
+#define NEW_EVENT(t,p,b) ((mouse_event_t){ .type = (t), .point = (p), .button = (b), .click_state = 1 })
+#define NEW_GESTURE(g,p)  ((mouse_event_t){ .type = kCGEventGesture, .point = (p), .gesture_type = (g) })
+#define NEW_SCROLL(u,p)   ((mouse_event_t){ .type = kCGEventScrollWheel, .point = (p), .scroll_units = (u) })
+#define RECORD(event) (MOUSE_RECORDING ? mouse_record(event) : (void)0)
+#define PROBE_POST(event) (MOUSE_PROBE_ENABLED(post) ? mouse_probe_post(event) : (void)0)
+#define POST(event) ((event).timestamp = mouse_now(), COUNT(posted), RECORD(&(event)), PROBE_POST(&(event)), device->backend->post(device->state, &(event)))
+#define FLUSH() (device->backend->flush ? device->backend->flush(device->state) : (void)0)
 
-static const double FPS     = 240;
-static const double QUANTUM = 1000000 / 240; // should be FPS, but GCC sucks
-static const double DEFAULT_DURATION      = 0.2; // seconds
-static const double DEFAULT_MAGNIFICATION = 1.0; // factor
+#define CLOSE_ENOUGH(a, b) ((fabs(a.x - b.x) < 1.0) && (fabs(a.y - b.y) < 1.0))
+#define FRAMES(seconds) ((uint_t)ceil(device->frame_rate * seconds))
+#define STOPPED (token && mouse_token_stopped(token))
+#define PROGRESS(done) if (token) token->progress = (done) // `done` may not be evaluated
 
-#define NEW_GESTURE(name) CGEventRef name = CGEventCreate(nil);	CHANGE(name, kCGEventGesture);
-#define NEW_EVENT(type,point,button) CGEventCreateMouseEvent(nil,type,point,button)
-#define POST(event) CGEventPost(kCGHIDEventTap, event)
-#define CHANGE(event,type) CGEventSetType(event, type)
+#define PLANNED(frames) (frames_planned += (frames))
+#define FRAME() (frames_posted++)
+#define COALESCED(frames) (frames_coalesced += (frames))
+#define OPERATION_BEGIN() const uint64_t operation_start = mouse_operation_begin(__func__)
+#define OPERATION_END(op) mouse_operation_end(op, operation_start, __func__)
 
-#define CLOSE_ENOUGH(a, b) ((fabs(a.x - b.x) < 1.0) && (fabs(a.y - b.y) < 1.0))
-#define NOW (CFDateCreate(nil, CFAbsoluteTimeGetCurrent()))
 
-#define POSTRELEASE(x) {                        \
-        CGEventRef const _event = x;            \
-        POST(_event);				\
-        CFRelease(_event);                      \
+#ifdef __APPLE__
+static mach_timebase_info_data_t timebase;
+#endif
+
+// Monotonic time in nanoseconds, measured from an arbitrary point in the past
+uint64_t
+mouse_clock_now()
+{
+#ifdef __APPLE__
+    if (!timebase.denom)
+        mach_timebase_info(&timebase);
+    return (mach_absolute_time() * timebase.numer) / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Block until the monotonic clock reaches `deadline`, as given by
+// mouse_clock_now(); returns immediately if the deadline has already passed.
+void
+mouse_clock_sleep_until(const uint64_t deadline)
+{
+#ifdef __APPLE__
+    if (!timebase.denom)
+        mach_timebase_info(&timebase);
+    mach_wait_until((deadline * timebase.denom) / timebase.numer);
+#else
+    const struct timespec until = {
+        .tv_sec  = (time_t)(deadline / 1000000000),
+        .tv_nsec = (long)(deadline % 1000000000)
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+#endif
+}
+
+// Time as the backend keeps it, which is the monotonic clock for every
+// backend so far, unless the clock is warped
+uint64_t
+mouse_now()
+{
+    if (device->time_warp)
+        return __atomic_load_n(&device->warped_now, __ATOMIC_ACQUIRE);
+    return device->backend->now();
+}
+
+// A warped clock only moves when something sleeps on it, and then jumps
+// straight to the deadline; threads sleeping on the same device at the
+// same time share its clock, so it only ever moves forward.
+static
+void
+mouse_warp_until(const uint64_t deadline)
+{
+    uint64_t now = __atomic_load_n(&device->warped_now, __ATOMIC_ACQUIRE);
+    while (now < deadline &&
+           !__atomic_compare_exchange_n(&device->warped_now, &now, deadline, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+static
+void
+mouse_sleep_until(const uint64_t deadline)
+{
+    FLUSH();
+    MOUSE_PROBE1(sleep__start, deadline);
+    if (device->time_warp)
+        mouse_warp_until(deadline);
+    else
+        device->backend->sleep_until(deadline);
+    MOUSE_PROBE1(sleep__done, deadline);
+}
+
+// Like mouse_sleep_until(), but wakes up every frame to see if the
+// operation has been stopped; returns false if it was
+static
+bool
+mouse_sleep_until_stopped(const uint64_t deadline)
+{
+    const uint64_t period = (uint64_t)(1000000000 / device->frame_rate);
+    for (uint64_t now = mouse_now(); now < deadline; now = mouse_now()) {
+        if (STOPPED)
+            return false;
+        mouse_sleep_until(deadline - now > period ? now + period : deadline);
+    }
+    return !STOPPED;
+}
+
+// Frame `n` of an animation is due exactly `n` frame periods after the
+// animation started. Waiting on absolute deadlines, rather than sleeping
+// for a period after each frame, keeps the time spent posting events
+// and any oversleeping from accumulating over the length of an animation.
+typedef struct {
+    uint64_t start;
+    double   period; // nanoseconds
+} mouse_schedule_t;
+
+static
+mouse_schedule_t
+mouse_schedule_begin(const double fps)
+{
+    const mouse_schedule_t schedule = {
+        .start  = mouse_now(),
+        .period = 1000000000 / fps
+    };
+    return schedule;
+}
+
+static
+uint64_t
+mouse_schedule_deadline(const mouse_schedule_t* const schedule, const size_t frame)
+{
+    // a frame too far off to be represented is due never
+    const double offset = frame * schedule->period;
+    if (!(offset < (double)(UINT64_MAX - schedule->start)))
+        return UINT64_MAX;
+    return schedule->start + (uint64_t)offset;
+}
+
+// Waits for the deadline of an animation frame, and records how late the
+// thread was by the time it woke up, unless it was stopped first
+static
+void
+mouse_schedule_wait(const mouse_schedule_t* const schedule, const size_t frame)
+{
+    const uint64_t deadline = mouse_schedule_deadline(schedule, frame);
+    if (!mouse_sleep_until_stopped(deadline))
+        return;
+    const uint64_t now = mouse_now();
+    mouse_stats_record_lateness(&device->stats, now > deadline ? now - deadline : 0);
+}
+
+// A thread that has fallen several frames behind, because it was
+// descheduled or the backend blocked, skips the moves it missed and posts
+// only the newest one, so that the animation still ends on time; being
+// a frame late is only timer slop, and is caught up by not sleeping.
+// Returns the latest frame up to `last` whose deadline has passed, or
+// `frame` if the thread is not that far behind. A warped clock is never
+// behind.
+static
+size_t
+mouse_schedule_catch_up(const mouse_schedule_t* const schedule,
+                        const size_t frame,
+                        const size_t last)
+{
+    if (!device->coalesce || frame >= last)
+        return frame;
+
+    const uint64_t now = mouse_now();
+    if (now <= schedule->start)
+        return frame;
+
+    const double due = floor((now - schedule->start) / schedule->period);
+    if (due < frame + 2)
+        return frame;
+
+    const size_t latest = due < last ? (size_t)due : last;
+    COALESCED(latest - frame);
+    return latest;
+}
+
+// Seconds since the schedule began
+static
+double
+mouse_schedule_elapsed(const mouse_schedule_t* const schedule)
+{
+    return (double)(mouse_now() - schedule->start) / 1000000000;
+}
+
+// Sleeps one frame at a time, so that a cancelled operation does not
+// have to wait out a long hold before it can stop
+static
+void
+mouse_sleep(const uint_t frames)
+{
+    const mouse_schedule_t schedule = mouse_schedule_begin(device->frame_rate);
+    for (uint_t frame = 1; frame <= frames && !STOPPED; frame++)
+        mouse_sleep_until(mouse_schedule_deadline(&schedule, frame));
+}
+
+static
+uint64_t
+mouse_operation_begin(const char* const function)
+{
+    MOUSE_PROBE2(operation__start, function, operation_depth);
+    if (!operation_depth++) {
+        frames_planned   = 0;
+        frames_posted    = 0;
+        frames_coalesced = 0;
     }
+    return mouse_now();
+}
+
+static
+void
+mouse_operation_end(const mouse_stats_operation_t operation,
+                    const uint64_t start,
+                    const char* const function)
+{
+    if (operation_depth == 1)
+        FLUSH();
+
+    const uint64_t elapsed = mouse_now() - start;
+    if (!--operation_depth)
+        mouse_stats_record_operation(&device->stats,
+                                     operation,
+                                     elapsed,
+                                     frames_planned,
+                                     frames_posted,
+                                     frames_coalesced);
+    MOUSE_PROBE3(operation__done, function, operation_depth, elapsed);
+}
+
+mouse_token_t*
+mouse_set_token(mouse_token_t* const new_token)
+{
+    mouse_token_t* const old_token = token;
+    token = new_token;
+    return old_token;
+}
+
+void
+mouse_token_cancel(mouse_token_t* const cancel_token)
+{
+    __atomic_store_n(&cancel_token->cancelled, true, __ATOMIC_RELEASE);
+}
+
+bool
+mouse_token_cancelled(const mouse_token_t* const cancel_token)
+{
+    return __atomic_load_n(&cancel_token->cancelled, __ATOMIC_ACQUIRE);
+}
 
+void
+mouse_token_set_timeout(mouse_token_t* const timeout_token, const double seconds)
+{
+    // clamped so the conversion and the addition cannot overflow
+    const double clamped = isfinite(seconds) ? fmin(fmax(seconds, 0), MAX_TIMEOUT) : MAX_TIMEOUT;
+    timeout_token->deadline = mouse_now() + (uint64_t)(clamped * 1000000000);
+}
+
+// Only the thread running the operation should check its token, since
+// this is also where a passed deadline gets recorded
+bool
+mouse_token_stopped(mouse_token_t* const stop_token)
+{
+    for (const mouse_token_t* link = stop_token; link; link = link->parent)
+        if (mouse_token_cancelled(link))
+            return true;
+
+    if (stop_token->deadline && mouse_now() >= stop_token->deadline)
+        stop_token->timed_out = true;
+
+    return stop_token->timed_out;
+}
+
+// Only called while something is attached to the post probe
+static
+void
+mouse_probe_post(const mouse_event_t* const event)
+{
+    MOUSE_PROBE3(post, (int)event->type, (long)event->point.x, (long)event->point.y);
+}
 
 static
 void
-mouse_sleep(const uint_t quanta)
+mouse_record(const mouse_event_t* const event)
+{
+    const mouse_trace_record_t record = mouse_event_record(event);
+    mouse_recorder_push(&record);
+}
+
+void
+mouse_backend_created()
+{
+    COUNT(created);
+}
+
+void
+mouse_backend_dropped(const size_t events)
+{
+    __atomic_fetch_add(&device->event_counts.dropped, events, __ATOMIC_RELAXED);
+}
+
+mouse_event_counts_t
+mouse_event_counts()
+{
+    const mouse_event_counts_t counts = {
+        .created = __atomic_load_n(&device->event_counts.created, __ATOMIC_RELAXED),
+        .posted  = __atomic_load_n(&device->event_counts.posted,  __ATOMIC_RELAXED),
+        .dropped = __atomic_load_n(&device->event_counts.dropped, __ATOMIC_RELAXED)
+    };
+    return counts;
+}
+
+// The backend is opened before anything is allocated for the device, so
+// that a backend that cannot be used leaves nothing behind
+mouse_device_t*
+mouse_device_new(const mouse_backend_t* const backend)
+{
+    void* state = NULL;
+    if (backend->open && !(state = backend->open()))
+        return NULL;
+
+    mouse_device_t* const new_device = calloc(1, sizeof(mouse_device_t));
+    if (!new_device) {
+        if (backend->close)
+            backend->close(state);
+        return NULL;
+    }
+    new_device->backend    = backend;
+    new_device->state      = state;
+    new_device->frame_rate = DEFAULT_FPS;
+    new_device->profile    = kMouseProfileLinear;
+    new_device->coalesce   = true;
+    new_device->references = 1;
+    return new_device;
+}
+
+mouse_device_t*
+mouse_device_retain(mouse_device_t* const retain_device)
+{
+    __atomic_fetch_add(&retain_device->references, 1, __ATOMIC_RELAXED);
+    return retain_device;
+}
+
+// The default device is never freed, since it was never allocated
+void
+mouse_device_release(mouse_device_t* const release_device)
+{
+    if (__atomic_sub_fetch(&release_device->references, 1, __ATOMIC_ACQ_REL) ||
+        release_device == &default_device)
+        return;
+
+    if (release_device->attachment)
+        release_device->detach(release_device->attachment);
+    if (release_device->backend->close)
+        release_device->backend->close(release_device->state);
+    free(release_device);
+}
+
+void*
+mouse_device_attach(mouse_device_t* const attach_device,
+                    void* const attachment,
+                    void (* const detach)(void* const attachment))
+{
+    void* attached = NULL;
+    if (!__atomic_compare_exchange_n(&attach_device->attachment, &attached, attachment,
+                                     false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return attached;
+    attach_device->detach = detach;
+    return attachment;
+}
+
+void*
+mouse_device_attachment(mouse_device_t* const attach_device)
+{
+    return __atomic_load_n(&attach_device->attachment, __ATOMIC_ACQUIRE);
+}
+
+mouse_device_t*
+mouse_set_device(mouse_device_t* const new_device)
+{
+    mouse_device_t* const old_device = device;
+    device = new_device ? new_device : &default_device;
+    return old_device;
+}
+
+mouse_device_t*
+mouse_device()
+{
+    return device;
+}
+
+mouse_device_t*
+mouse_default_device()
+{
+    return &default_device;
+}
+
+void
+mouse_device_stats(mouse_stats_t* const snapshot)
+{
+    mouse_stats_snapshot(&device->stats, snapshot);
+}
+
+void
+mouse_device_reset_stats()
 {
-    usleep(quanta * (uint_t)QUANTUM);
+    mouse_stats_reset(&device->stats);
+}
+
+mouse_memory_t*
+mouse_memory()
+{
+    return device->backend == &mouse_memory_backend ? device->state : NULL;
 }
 
 CGPoint
 mouse_current_position()
 {
-    CGEventRef const event = CGEventCreate(nil);
-    const CGPoint point = CGEventGetLocation(event);
-    CFRelease(event);
-    return point;
+    return device->backend->position(device->state);
+}
+
+// The old backend is only closed once the new one is open, so that the
+// device can keep going if it cannot be
+bool
+mouse_set_backend(const mouse_backend_t* const new_backend)
+{
+    if (new_backend == device->backend)
+        return true;
+
+    void* state = NULL;
+    if (new_backend->open && !(state = new_backend->open()))
+        return false;
+
+    if (device->backend->close)
+        device->backend->close(device->state);
+    device->backend = new_backend;
+    device->state   = state;
+    return true;
+}
+
+const mouse_backend_t*
+mouse_backend()
+{
+    return device->backend;
+}
+
+void
+mouse_set_fps(const double fps)
+{
+    device->frame_rate = fmin(fmax(fps, 1), MAX_FPS);
+}
+
+double
+mouse_fps()
+{
+    return device->frame_rate;
+}
+
+// The warped clock starts from the time on the real one, so that the
+// timestamps of events carry on from those posted before
+void
+mouse_set_time_warp(const bool enabled)
+{
+    if (enabled && !device->time_warp)
+        __atomic_store_n(&device->warped_now, device->backend->now(), __ATOMIC_RELEASE);
+    device->time_warp = enabled;
+}
+
+bool
+mouse_time_warp()
+{
+    return device->time_warp;
+}
+
+void
+mouse_set_coalesce(const bool enabled)
+{
+    device->coalesce = enabled;
+}
+
+bool
+mouse_coalesce()
+{
+    return device->coalesce;
+}
+
+void
+mouse_set_dead_reckoning(const bool enabled)
+{
+    device->dead_reckoning = enabled;
 }
 
-// Executes a linear mouse movement animation. It can be a simple cursor
-// move or a drag depending on what is passed to `type`.
+bool
+mouse_dead_reckoning()
+{
+    return device->dead_reckoning;
+}
+
+void
+mouse_set_profile(const mouse_profile_t profile)
+{
+    device->profile = profile;
+}
+
+mouse_profile_t
+mouse_profile()
+{
+    return device->profile;
+}
+
+// Open loop version of mouse_animate(); the cursor is assumed to be
+// wherever the previous frame put it, so the window server is only asked
+// where the cursor really is once the animation is over. If something
+// else moved the cursor in the meantime then one extra event is posted
+// to put it where it was supposed to end up.
+//
+// Nothing is allocated per frame, the one event is moved and reposted.
 static
 void
-mouse_animate(const CGEventType type,
-	      const CGMouseButton button,
-	      const CGPoint start_point,
-	      const CGPoint end_point,
-	      const double duration)
+mouse_animate_dead_reckoning(mouse_event_t* const event,
+                             const CGPoint start_point,
+                             const CGPoint end_point,
+                             const mouse_plan_t* const plan)
+{
+    const size_t steps = plan->steps;
+    const mouse_schedule_t schedule = mouse_schedule_begin(plan->key.fps);
+    PLANNED(steps);
+
+    for (size_t step = 1; step <= steps && !STOPPED; step++) {
+        // frame `step` is due once frame `step - 1` has been waited for
+        step = mouse_schedule_catch_up(&schedule, step - 1, steps - 1) + 1;
+        event->point = CGPointMake(start_point.x + plan->offsets[step].x,
+                                   start_point.y + plan->offsets[step].y);
+        POST(*event);
+        FRAME();
+        PROGRESS((double)step / (double)steps);
+        mouse_schedule_wait(&schedule, step);
+    }
+
+    if (!STOPPED && !CLOSE_ENOUGH(mouse_current_position(), end_point)) {
+        event->point = end_point;
+        POST(*event);
+    }
+}
+
+// Each frame moves the cursor from wherever it really is by as much as
+// the plan says it should move for that frame. If the cursor is still
+// not there once the plan runs out, because something else moved it,
+// it keeps stepping towards the end at the average pace of the plan.
+//
+// Asking the window server for the cursor position still costs an
+// allocation per frame; use dead reckoning for a loop that allocates
+// nothing.
+static
+void
+mouse_animate_closed_loop(mouse_event_t* const event,
+                          const CGPoint start_point,
+                          const CGPoint end_point,
+                          const mouse_plan_t* const plan)
 {
+    const size_t     steps = plan->steps;
+    const double     xstep = plan->key.dx / steps;
+    const double     ystep = plan->key.dy / steps;
     CGPoint current_point  = start_point;
-    const double     xstep = (end_point.x - start_point.x) / (duration * FPS);
-    const double     ystep = (end_point.y - start_point.y) / (duration * FPS);
-    CFDateRef  const start = NOW;
+    CGPoint  posted_point  = start_point;
+    const mouse_schedule_t schedule = mouse_schedule_begin(plan->key.fps);
     double       remaining = 0.0;
-    CFDateRef current_time = NULL;
-
-    while (!CLOSE_ENOUGH(current_point, end_point)) {
-        remaining  = end_point.x - current_point.x;
-        current_point.x += fabs(xstep) > fabs(remaining) ? remaining : xstep;
+    size_t           frame = 0;
+    PLANNED(steps);
+
+    while (!CLOSE_ENOUGH(current_point, end_point) && !STOPPED) {
+        if (frame < steps) {
+            // frames that are already late are skipped over
+            frame = mouse_schedule_catch_up(&schedule, frame, steps - 1);
+
+            // comparing against the previous frame, rather than moving
+            // from the current position, keeps the cursor from falling
+            // behind if the window server rounds positions
+            const CGPoint offset = plan->offsets[frame + 1];
+            current_point.x = start_point.x + offset.x + (current_point.x - posted_point.x);
+            current_point.y = start_point.y + offset.y + (current_point.y - posted_point.y);
+        }
+        else {
+            remaining  = end_point.x - current_point.x;
+            current_point.x += fabs(xstep) > fabs(remaining) ? remaining : xstep;
 
-        remaining  = end_point.y - current_point.y;
-        current_point.y += fabs(ystep) > fabs(remaining) ? remaining : ystep;
+            remaining  = end_point.y - current_point.y;
+            current_point.y += fabs(ystep) > fabs(remaining) ? remaining : ystep;
+        }
 
-        POSTRELEASE(NEW_EVENT(type, current_point, button));
+        event->point = current_point;
+        POST(*event);
+        FRAME();
+        posted_point = current_point;
+        frame++;
+        PROGRESS(fmin(1, frame / (double)steps));
 
-        mouse_sleep(1);
-        current_time = NOW;
+        mouse_schedule_wait(&schedule, frame);
 
         // this is a safety
-        const double boundary = duration + 1;
-        if (CFDateGetTimeIntervalSinceDate(current_time, start) > boundary)
+        const double boundary = plan->key.duration + 1;
+        if (mouse_schedule_elapsed(&schedule) > boundary)
             break;
 
-        CFRelease(current_time);
-        current_time = NULL;
-
         current_point = mouse_current_position();
     }
-
-    CFRelease(start);
-    if (current_time)
-        CFRelease(current_time);
 }
 
+// Executes a mouse movement animation. It can be a simple cursor move or
+// a drag depending on what is passed to `type`. The whole trajectory is
+// planned, or found in the plan cache, before the first frame is posted,
+// so each frame only has to look up where it should be.
+//
+// The same event is reused for every frame.
+static
+void
+mouse_animate(const CGEventType type,
+	      const CGMouseButton button,
+	      const CGPoint start_point,
+	      const CGPoint end_point,
+	      const double duration,
+	      const double fps,
+	      const mouse_profile_t profile)
+{
+    if (CLOSE_ENOUGH(start_point, end_point))
+        return;
+
+    const CGPoint delta = CGPointMake(end_point.x - start_point.x,
+                                      end_point.y - start_point.y);
+    mouse_plan_t* const cached = mouse_plan_get(delta, duration, fps, profile, NULL);
+
+    // an animation still runs without memory for a plan, if more coarsely
+    mouse_plan_fallback_t fallback;
+    const mouse_plan_t* const plan = cached ? cached :
+        mouse_plan_fallback(&fallback, delta, duration, fps, profile);
+
+    mouse_event_t event = NEW_EVENT(type, start_point, button);
+    if (device->dead_reckoning)
+        mouse_animate_dead_reckoning(&event, start_point, end_point, plan);
+    else
+        mouse_animate_closed_loop(&event, start_point, end_point, plan);
+
+    if (cached)
+        mouse_plan_release(cached);
+}
 
 void
-mouse_move_to2(const CGPoint point, const double duration)
+mouse_move_to4(const CGPoint point,
+               const double duration,
+               const double fps,
+               const mouse_profile_t profile)
 {
+    OPERATION_BEGIN();
     mouse_animate(kCGEventMouseMoved,
                   kCGMouseButtonLeft,
                   mouse_current_position(),
                   point,
-                  duration);
+                  duration,
+                  fps,
+                  profile);
+    OPERATION_END(kMouseStatsMoveTo);
+}
+
+void
+mouse_move_to3(const CGPoint point, const double duration, const double fps)
+{
+    mouse_move_to4(point, duration, fps, device->profile);
+}
+
+void
+mouse_move_to2(const CGPoint point, const double duration)
+{
+    mouse_move_to3(point, duration, device->frame_rate);
 }
 
 void
@@ -107,22 +756,106 @@ mouse_move_to(const CGPoint point)
 }
 
 
+// Read with memcpy since points in a packed buffer need not be aligned
+static
+CGPoint
+mouse_path_point(const void* const path, const size_t index)
+{
+    double xy[2];
+    memcpy(xy, (const char*)path + (index * sizeof(xy)), sizeof(xy));
+    return CGPointMake(xy[0], xy[1]);
+}
+
+// The cursor jumps to the start of the path, then each frame moves it to
+// wherever it should be along the path by then, interpolating between
+// points or skipping over them depending on how many points there are
+// for each frame.
 void
-mouse_drag_to2(const CGPoint point, const double duration)
+mouse_follow_path3(const void* const path,
+                   const size_t points,
+                   const double duration,
+                   const double fps)
+{
+    if (!points)
+        return;
+
+    OPERATION_BEGIN();
+    const size_t steps = fmax(1, round(duration * fps));
+    const double  last = points - 1;
+    mouse_event_t event = NEW_EVENT(kCGEventMouseMoved,
+                                    mouse_path_point(path, 0),
+                                    kCGMouseButtonLeft);
+    const mouse_schedule_t schedule = mouse_schedule_begin(fps);
+    PLANNED(steps);
+    POST(event);
+
+    for (size_t step = 1; step <= steps && !STOPPED; step++) {
+        mouse_schedule_wait(&schedule, step);
+        step = mouse_schedule_catch_up(&schedule, step, steps);
+
+        const double  done = (double)step / (double)steps;
+        const double where = done * last;
+        const size_t index = (size_t)where;
+        const CGPoint from = mouse_path_point(path, index);
+        const CGPoint   to = index < last ? mouse_path_point(path, index + 1) : from;
+        const double  part = where - index;
+
+        event.point = CGPointMake(from.x + ((to.x - from.x) * part),
+                                  from.y + ((to.y - from.y) * part));
+        POST(event);
+        FRAME();
+        PROGRESS(done);
+    }
+
+    OPERATION_END(kMouseStatsFollowPath);
+}
+
+void
+mouse_follow_path2(const void* const path,
+                   const size_t points,
+                   const double duration)
+{
+    mouse_follow_path3(path, points, duration, device->frame_rate);
+}
+
+
+void
+mouse_drag_to4(const CGPoint point,
+               const double duration,
+               const double fps,
+               const mouse_profile_t profile)
 {
-    POSTRELEASE(NEW_EVENT(kCGEventLeftMouseDown,
-                          mouse_current_position(),
-                          kCGMouseButtonLeft));
+    OPERATION_BEGIN();
+    mouse_event_t down = NEW_EVENT(kCGEventLeftMouseDown,
+                                   mouse_current_position(),
+                                   kCGMouseButtonLeft);
+    POST(down);
 
     mouse_animate(kCGEventLeftMouseDragged,
                   kCGMouseButtonLeft,
                   mouse_current_position(),
                   point,
-                  duration);
+                  duration,
+                  fps,
+                  profile);
+
+    mouse_event_t up = NEW_EVENT(kCGEventLeftMouseUp,
+                                 mouse_current_position(),
+                                 kCGMouseButtonLeft);
+    POST(up);
+    OPERATION_END(kMouseStatsDragTo);
+}
 
-    POSTRELEASE(NEW_EVENT(kCGEventLeftMouseUp,
-                          mouse_current_position(),
-                          kCGMouseButtonLeft));
+void
+mouse_drag_to3(const CGPoint point, const double duration, const double fps)
+{
+    mouse_drag_to4(point, duration, fps, device->profile);
+}
+
+void
+mouse_drag_to2(const CGPoint point, const double duration)
+{
+    mouse_drag_to3(point, duration, device->frame_rate);
 }
 
 void
@@ -133,24 +866,42 @@ mouse_drag_to(const CGPoint point)
 
 
 #define SCROLL(vval, hval) {                                  \
-        const size_t steps = round(FPS * duration);           \
+        const size_t steps = round(fps * duration);           \
+        mouse_event_t event = NEW_SCROLL(units, mouse_current_position()); \
+        const mouse_schedule_t schedule = mouse_schedule_begin(fps); \
         double current = 0.0;                                 \
+        PLANNED(steps);                                       \
                                                               \
-        for (size_t step = 0; step < steps; step++) {                  \
+        for (size_t step = 0; step < steps && !STOPPED; step++) {    \
             const double   done = (double)(step+1) / (double)steps;    \
             const double scroll = round((done - current) * amount);    \
-            POSTRELEASE(CGEventCreateScrollWheelEvent(nil, units, 2, vval, hval)); \
-            mouse_sleep(2);                                             \
+            event.scroll_vertical   = vval;                             \
+            event.scroll_horizontal = hval;                             \
+            POST(event);                                                \
+            FRAME();                                                    \
+            PROGRESS(done);                                             \
+            mouse_schedule_wait(&schedule, step + 1);                   \
             current += scroll / (double)amount;                         \
         }                                                              \
     }
 
+void
+mouse_scroll4(const int amount,
+              const CGScrollEventUnit units,
+              const double duration,
+              const double fps)
+{
+    OPERATION_BEGIN();
+    SCROLL(scroll, 0);
+    OPERATION_END(kMouseStatsScroll);
+}
+
 void
 mouse_scroll3(const int amount,
               const CGScrollEventUnit units,
               const double duration)
 {
-    SCROLL(scroll, 0);
+    mouse_scroll4(amount, units, duration, device->frame_rate);
 }
 
 void
@@ -166,12 +917,23 @@ mouse_scroll(const int amount)
     mouse_scroll2(amount, kCGScrollEventUnitLine);
 }
 
+void
+mouse_horizontal_scroll4(const int amount,
+                         const CGScrollEventUnit units,
+                         const double duration,
+                         const double fps)
+{
+    OPERATION_BEGIN();
+    SCROLL(0, scroll);
+    OPERATION_END(kMouseStatsHorizontalScroll);
+}
+
 void
 mouse_horizontal_scroll3(const int amount,
                          const CGScrollEventUnit units,
                          const double duration)
 {
-    SCROLL(0, scroll);
+    mouse_horizontal_scroll4(amount, units, duration, device->frame_rate);
 }
 
 void
@@ -187,17 +949,94 @@ mouse_horizontal_scroll(const int amount)
     mouse_horizontal_scroll2(amount, kCGScrollEventUnitLine);
 }
 
+
+// Pages behind the replay are given back every this many records
+#define REPLAY_CHUNK 4096
+
+static
+bool
+mouse_event_is_move(const CGEventType type)
+{
+    return type == kCGEventMouseMoved ||
+           type == kCGEventLeftMouseDragged ||
+           type == kCGEventRightMouseDragged ||
+           type == kCGEventOtherMouseDragged;
+}
+
+// A move can be left out of a replay that has fallen behind when the
+// move after it is of the same kind, and even the record after that is
+// already due; as with animations, being one record late is only timer
+// slop. Button and scroll events are always replayed.
+static
+bool
+mouse_replay_stale(const mouse_trace_t* const trace,
+                   const size_t index,
+                   const uint64_t start,
+                   const uint64_t first)
+{
+    if (!device->coalesce || index + 2 >= trace->count)
+        return false;
+
+    const mouse_trace_record_t* const record = &trace->records[index];
+    const mouse_trace_record_t* const next   = &trace->records[index + 1];
+    const mouse_trace_record_t* const after  = &trace->records[index + 2];
+    if (!mouse_event_is_move(record->type) || next->type != record->type)
+        return false;
+    if (after->timestamp <= record->timestamp)
+        return false;
+
+    const uint64_t offset = after->timestamp > first ? after->timestamp - first : 0;
+    return mouse_now() >= start + offset;
+}
+
+void
+mouse_replay(const mouse_trace_t* const trace)
+{
+    if (!trace->count)
+        return;
+
+    OPERATION_BEGIN();
+    const uint64_t start = mouse_now();
+    const uint64_t first = trace->records[0].timestamp;
+    PLANNED(trace->count);
+
+    for (size_t i = 0; i < trace->count; i++) {
+        const mouse_trace_record_t* const record = &trace->records[i];
+        if (mouse_replay_stale(trace, i, start, first)) {
+            COALESCED(1);
+        }
+        else {
+            const uint64_t offset = record->timestamp > first ? record->timestamp - first : 0;
+            if (!mouse_sleep_until_stopped(start + offset))
+                break;
+
+            mouse_event_t event = mouse_record_event(record);
+            POST(event);
+            FRAME();
+        }
+        PROGRESS((double)(i + 1) / (double)trace->count);
+
+        if (!((i + 1) % REPLAY_CHUNK))
+            mouse_trace_discard(trace, i + 1);
+    }
+
+    OPERATION_END(kMouseStatsReplay);
+}
+
 void
-mouse_click_down3(const CGPoint point, const uint_t sleep_quanta)
+mouse_click_down3(const CGPoint point, const uint_t sleep_frames)
 {
-    POSTRELEASE(NEW_EVENT(kCGEventLeftMouseDown, point, kCGMouseButtonLeft));
-    mouse_sleep(sleep_quanta);
+    OPERATION_BEGIN();
+    mouse_event_t event = NEW_EVENT(kCGEventLeftMouseDown, point, kCGMouseButtonLeft);
+    POST(event);
+    mouse_sleep(sleep_frames);
+    OPERATION_END(kMouseStatsClickDown);
 }
 
 void
 mouse_click_down2(const CGPoint point)
 {
-    mouse_click_down3(point, FPS / 10);
+    mouse_click_down3(point, FRAMES(HOLD));
 }
 
 void
@@ -210,7 +1049,10 @@ mouse_click_down()
 void
 mouse_click_up2(const CGPoint point)
 {
-    POSTRELEASE(NEW_EVENT(kCGEventLeftMouseUp, point, kCGMouseButtonLeft));
+    OPERATION_BEGIN();
+    mouse_event_t event = NEW_EVENT(kCGEventLeftMouseUp, point, kCGMouseButtonLeft);
+    POST(event);
+    OPERATION_END(kMouseStatsClickUp);
 }
 
 void
@@ -223,8 +1065,10 @@ mouse_click_up()
 void
 mouse_click2(const CGPoint point)
 {
+    OPERATION_BEGIN();
     mouse_click_down2(point);
     mouse_click_up2(point);
+    OPERATION_END(kMouseStatsClick);
 }
 
 void
@@ -235,19 +1079,21 @@ mouse_click()
 
 
 void
-mouse_secondary_click_down3(const CGPoint point, const uint_t sleep_quanta)
+mouse_secondary_click_down3(const CGPoint point, const uint_t sleep_frames)
 {
-    CGEventRef const base_event = NEW_EVENT(kCGEventRightMouseDown,
-                                            point,
-                                            kCGMouseButtonRight);
-    POSTRELEASE(base_event);
-    mouse_sleep(sleep_quanta);
+    OPERATION_BEGIN();
+    mouse_event_t event = NEW_EVENT(kCGEventRightMouseDown,
+                                    point,
+                                    kCGMouseButtonRight);
+    POST(event);
+    mouse_sleep(sleep_frames);
+    OPERATION_END(kMouseStatsClickDown);
 }
 
 void
 mouse_secondary_click_down2(const CGPoint point)
 {
-    mouse_secondary_click_down3(point, FPS / 10);
+    mouse_secondary_click_down3(point, FRAMES(HOLD));
 }
 
 void
@@ -260,10 +1106,12 @@ mouse_secondary_click_down()
 void
 mouse_secondary_click_up2(const CGPoint point)
 {
-    CGEventRef const base_event = NEW_EVENT(kCGEventRightMouseUp,
-                                            point,
-                                            kCGMouseButtonRight);
-    POSTRELEASE(base_event);
+    OPERATION_BEGIN();
+    mouse_event_t event = NEW_EVENT(kCGEventRightMouseUp,
+                                    point,
+                                    kCGMouseButtonRight);
+    POST(event);
+    OPERATION_END(kMouseStatsClickUp);
 }
 
 void
@@ -274,44 +1122,52 @@ mouse_secondary_click_up()
 
 
 void
-mouse_secondary_click3(const CGPoint point, const uint_t sleep_quanta)
+mouse_secondary_click3(const CGPoint point, const uint_t sleep_frames)
 {
-    mouse_secondary_click_down3(point, sleep_quanta);
+    OPERATION_BEGIN();
+    mouse_secondary_click_down3(point, sleep_frames);
     mouse_secondary_click_up2(point);
+    OPERATION_END(kMouseStatsClick);
 }
 
 void
 mouse_secondary_click2(const CGPoint point)
 {
+    OPERATION_BEGIN();
     mouse_secondary_click_down2(point);
     mouse_secondary_click_up2(point);
+    OPERATION_END(kMouseStatsClick);
 }
 
 void
 mouse_secondary_click()
 {
+    OPERATION_BEGIN();
     mouse_secondary_click_down();
     mouse_secondary_click_up();
+    OPERATION_END(kMouseStatsClick);
 }
 
 
 void
 mouse_arbitrary_click_down3(const CGEventMouseSubtype button,
 			    const CGPoint point,
-			    const uint_t sleep_quanta)
+			    const uint_t sleep_frames)
 {
-    CGEventRef const base_event = NEW_EVENT(kCGEventOtherMouseDown,
-                                            point,
-                                            button);
-    POSTRELEASE(base_event);
-    mouse_sleep(sleep_quanta);
+    OPERATION_BEGIN();
+    mouse_event_t event = NEW_EVENT(kCGEventOtherMouseDown,
+                                    point,
+                                    button);
+    POST(event);
+    mouse_sleep(sleep_frames);
+    OPERATION_END(kMouseStatsClickDown);
 }
 
 void
 mouse_arbitrary_click_down2(const CGEventMouseSubtype button,
                             const CGPoint point)
 {
-    mouse_arbitrary_click_down3(button, point, FPS / 10);
+    mouse_arbitrary_click_down3(button, point, FRAMES(HOLD));
 }
 
 void
@@ -324,10 +1180,12 @@ mouse_arbitrary_click_down(const CGEventMouseSubtype button)
 void mouse_arbitrary_click_up2(const CGEventMouseSubtype button,
                                const CGPoint point)
 {
-    CGEventRef const base_event = NEW_EVENT(kCGEventOtherMouseUp,
-                                            point,
-                                            button);
-    POSTRELEASE(base_event);
+    OPERATION_BEGIN();
+    mouse_event_t event = NEW_EVENT(kCGEventOtherMouseUp,
+                                    point,
+                                    button);
+    POST(event);
+    OPERATION_END(kMouseStatsClickUp);
 }
 
 void mouse_arbitrary_click_up(const CGEventMouseSubtype button)
@@ -339,25 +1197,31 @@ void mouse_arbitrary_click_up(const CGEventMouseSubtype button)
 void
 mouse_arbitrary_click3(const CGEventMouseSubtype button,
                        const CGPoint point,
-                       const uint_t sleep_quanta)
+                       const uint_t sleep_frames)
 {
-    mouse_arbitrary_click_down3(button, point, sleep_quanta);
+    OPERATION_BEGIN();
+    mouse_arbitrary_click_down3(button, point, sleep_frames);
     mouse_arbitrary_click_up2(button, point);
+    OPERATION_END(kMouseStatsClick);
 }
 
 void
 mouse_arbitrary_click2(const CGEventMouseSubtype button,
                        const CGPoint point)
 {
+    OPERATION_BEGIN();
     mouse_arbitrary_click_down2(button, point);
     mouse_arbitrary_click_up2(button, point);
+    OPERATION_END(kMouseStatsClick);
 }
 
 void
 mouse_arbitrary_click(const CGEventMouseSubtype button)
 {
+    OPERATION_BEGIN();
     mouse_arbitrary_click_down(button);
     mouse_arbitrary_click_up(button);
+    OPERATION_END(kMouseStatsClick);
 }
 
 
@@ -377,18 +1241,16 @@ mouse_middle_click()
 void
 mouse_multi_click2(const size_t num_clicks, const CGPoint point)
 {
-    CGEventRef const base_event = NEW_EVENT(kCGEventLeftMouseDown,
-                                            point,
-                                            kCGMouseButtonLeft);
-    CGEventSetIntegerValueField(base_event,
-                                kCGMouseEventClickState,
-                                num_clicks);
-
-    CHANGE(base_event, kCGEventLeftMouseDown);
-    POST(base_event);
-
-    CHANGE(base_event, kCGEventLeftMouseUp);
-    POSTRELEASE(base_event);
+    OPERATION_BEGIN();
+    mouse_event_t event = NEW_EVENT(kCGEventLeftMouseDown,
+                                    point,
+                                    kCGMouseButtonLeft);
+    event.click_state = num_clicks;
+    POST(event);
+
+    event.type = kCGEventLeftMouseUp;
+    POST(event);
+    OPERATION_END(kMouseStatsMultiClick);
 }
 
 void
@@ -401,10 +1263,12 @@ mouse_multi_click(const size_t num_clicks)
 void
 mouse_double_click2(const CGPoint point)
 {
+    OPERATION_BEGIN();
     // some apps still expect to receive the single click event first
     // and then the double click event
     mouse_multi_click2(1, point);
     mouse_multi_click2(2, point);
+    OPERATION_END(kMouseStatsMultiClick);
 }
 
 void
@@ -417,10 +1281,12 @@ mouse_double_click()
 void
 mouse_triple_click2(const CGPoint point)
 {
+    OPERATION_BEGIN();
     // some apps still expect to receive the single click event first
     // and then the double and triple click events
     mouse_double_click2(point);
     mouse_multi_click2(3, point);
+    OPERATION_END(kMouseStatsMultiClick);
 }
 
 void
@@ -430,41 +1296,92 @@ mouse_triple_click()
 }
 
 
+// A button that is held down is always let go, even if the operation is
+// stopped during the hold, which is short enough to wait out
+void
+mouse_click_all(const void* const points,
+                const size_t count,
+                const CGEventMouseSubtype button,
+                const double hold,
+                const double interval)
+{
+    if (!count)
+        return;
+
+    OPERATION_BEGIN();
+    const CGEventType down =
+        button == kCGMouseButtonLeft  ? kCGEventLeftMouseDown  :
+        button == kCGMouseButtonRight ? kCGEventRightMouseDown : kCGEventOtherMouseDown;
+    const CGEventType up =
+        button == kCGMouseButtonLeft  ? kCGEventLeftMouseUp  :
+        button == kCGMouseButtonRight ? kCGEventRightMouseUp : kCGEventOtherMouseUp;
+
+    const uint64_t held   = (uint64_t)(fmax(hold, 0) * 1000000000);
+    const uint64_t period = held + (uint64_t)(fmax(interval, 0) * 1000000000);
+    const uint64_t start  = mouse_now();
+    mouse_event_t event = NEW_EVENT(down, mouse_path_point(points, 0), button);
+    PLANNED(count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!mouse_sleep_until_stopped(start + (i * period)))
+            break;
+
+        event.type  = down;
+        event.point = mouse_path_point(points, i);
+        POST(event);
+        if (held)
+            mouse_sleep_until(start + (i * period) + held);
+
+        event.type = up;
+        POST(event);
+        FRAME();
+        PROGRESS((double)(i + 1) / (double)count);
+    }
+
+    OPERATION_END(kMouseStatsClickAll);
+}
+
+
+// The body of a gesture is a plain function with a context, rather than
+// a block, so that the core can be built by compilers without blocks
+typedef void (*mouse_gesture_body_t)(const CGPoint point, const void* const context);
+
 static
 void
 mouse_gesture(const CGPoint point,
-              const uint_t sleep_quanta,
-              void (^ const gesture_block)(void))
+              const uint_t sleep_frames,
+              const mouse_gesture_body_t body,
+              const void* const context)
 {
-    POSTRELEASE(NEW_EVENT(kCGEventMouseMoved, point, kCGMouseButtonLeft));
+    mouse_event_t move = NEW_EVENT(kCGEventMouseMoved, point, kCGMouseButtonLeft);
+    POST(move);
 
-    NEW_GESTURE(gesture);
-    CGEventSetIntegerValueField(gesture,
-                                kCGEventGestureType,
-                                kCGGestureTypeGestureStarted);
+    mouse_event_t gesture = NEW_GESTURE(kCGGestureTypeGestureStarted, point);
     POST(gesture);
 
-    gesture_block();
+    body(point, context);
 
-    CGEventSetIntegerValueField(gesture,
-                                kCGEventGestureType,
-                                kCGGestureTypeGestureEnded);
-    POSTRELEASE(gesture);
+    gesture.gesture_type = kCGGestureTypeGestureEnded;
+    POST(gesture);
 
-    mouse_sleep(sleep_quanta);
+    mouse_sleep(sleep_frames);
+}
+
+static
+void
+mouse_smart_magnify_body(const CGPoint point,
+                         const void* const context __attribute__ ((unused)))
+{
+    mouse_event_t event = NEW_GESTURE(kCGGestureTypeSmartMagnify, point);
+    POST(event);
 }
 
 void
 mouse_smart_magnify2(const CGPoint point)
 {
-    mouse_gesture(point, (FPS / 2), ^(void)
-    {
-        NEW_GESTURE(event);
-        CGEventSetIntegerValueField(event,
-                                    kCGEventGestureType,
-                                    kCGGestureTypeSmartMagnify);
-        POSTRELEASE(event);
-    });
+    OPERATION_BEGIN();
+    mouse_gesture(point, FRAMES(MAGNIFY_HOLD), mouse_smart_magnify_body, NULL);
+    OPERATION_END(kMouseStatsSmartMagnify);
 }
 
 void
@@ -473,29 +1390,50 @@ mouse_smart_magnify()
     mouse_smart_magnify2(mouse_current_position());
 }
 
+typedef struct {
+    CGSwipeDirection direction;
+    CGFloat          distance;
+    CGGestureMotion  motion;
+} mouse_swipe_t;
+
+static
+void
+mouse_swipe_body(const CGPoint point, const void* const context)
+{
+    const mouse_swipe_t* const s = context;
+    mouse_event_t swipe = NEW_GESTURE(kCGGestureTypeSwipe, point);
+
+    swipe.swipe_motion    = s->motion;
+    swipe.swipe_direction = s->direction;
+    swipe.gesture_phase   = kCGGesturePhaseBegan;
+    swipe.gesture_value   = s->distance;
+    swipe.swipe_position  = s->distance;
+
+    // TODO: animation steps don't seem to do anything...
+    // kCGGesturePhaseChanged
+    // kCGGesturePhaseEnded
+
+    POST(swipe);
+}
+
 void
 mouse_swipe2(const CGSwipeDirection direction, const CGPoint point)
 {
-    uint16_t            axis = 0;
     CGFloat         distance = 1.0;
     CGGestureMotion   motion = kCGGestureMotionNone;
 
     switch (direction) {
     case kCGSwipeDirectionUp:
-        axis     = kCGEventGestureSwipePositionY;
         distance = -(distance);
         motion   = kCGGestureMotionVertical;
         break;
     case kCGSwipeDirectionDown:
-        axis     = kCGEventGestureSwipePositionY;
         motion   = kCGGestureMotionVertical;
         break;
     case kCGSwipeDirectionLeft:
-        axis     = kCGEventGestureSwipePositionX;
         motion   = kCGGestureMotionHorizontal;
         break;
     case kCGSwipeDirectionRight:
-        axis     = kCGEventGestureSwipePositionX;
         distance = -(distance);
         motion   = kCGGestureMotionHorizontal;
         break;
@@ -503,23 +1441,14 @@ mouse_swipe2(const CGSwipeDirection direction, const CGPoint point)
         return;
     }
 
-    mouse_gesture(point, (FPS / 10), ^(void)
-    {
-        NEW_GESTURE(swipe);
-
-        CGEventSetIntegerValueField(swipe, kCGEventGestureType,           kCGGestureTypeSwipe);
-        CGEventSetIntegerValueField(swipe, kCGEventGestureSwipeMotion,    motion);
-        CGEventSetIntegerValueField(swipe, kCGEventGestureSwipeDirection, direction);
-        CGEventSetIntegerValueField(swipe, kCGEventGesturePhase,          kCGGesturePhaseBegan);
-        CGEventSetDoubleValueField( swipe, kCGEventGestureSwipeProgress,  distance);
-        CGEventSetDoubleValueField( swipe, axis,                          distance);
-
-        // TODO: animation steps don't seem to do anything...
-        // kCGGesturePhaseChanged
-        // kCGGesturePhaseEnded
-
-        POSTRELEASE(swipe);
-    });
+    const mouse_swipe_t swipe = {
+        .direction = direction,
+        .distance  = distance,
+        .motion    = motion
+    };
+    OPERATION_BEGIN();
+    mouse_gesture(point, FRAMES(HOLD), mouse_swipe_body, &swipe);
+    OPERATION_END(kMouseStatsSwipe);
 }
 
 void
@@ -528,11 +1457,42 @@ mouse_swipe(const CGSwipeDirection direction)
     mouse_swipe2(direction, mouse_current_position());
 }
 
+// Pinches and rotations post the same step of their gesture every frame
+typedef struct {
+    CGGestureType type;
+    double        total;
+    double        duration;
+    double        fps;
+} mouse_gesture_steps_t;
+
+static
 void
-mouse_pinch4(const CGPinchDirection direction,
+mouse_gesture_steps_body(const CGPoint point, const void* const context)
+{
+    const mouse_gesture_steps_t* const g = context;
+    mouse_event_t event = NEW_GESTURE(g->type, point);
+
+    const size_t steps       = fmax(1, round(g->fps * g->duration));
+    const double step_size   = g->total / steps;
+    const mouse_schedule_t schedule = mouse_schedule_begin(g->fps);
+
+    event.gesture_value = step_size;
+    PLANNED(steps);
+
+    for (size_t i = 0; i < steps && !STOPPED; i++) {
+        POST(event);
+        FRAME();
+        PROGRESS((double)(i + 1) / (double)steps);
+        mouse_schedule_wait(&schedule, i + 1);
+    }
+}
+
+void
+mouse_pinch5(const CGPinchDirection direction,
 	     const double magnification,
- 	     const CGPoint point,
-	     const double duration)
+	     const CGPoint point,
+	     const double duration,
+	     const double fps)
 {
     double _magnification = magnification;
 
@@ -546,26 +1506,24 @@ mouse_pinch4(const CGPinchDirection direction,
         return;
     }
 
-    mouse_gesture(point, FPS / 10, ^(void)
-    {
-        NEW_GESTURE(pinch);
-        CGEventSetIntegerValueField(pinch,
-                                    kCGEventGestureType,
-                                    kCGGestureTypePinch);
-
-        const size_t steps       = FPS / duration;
-        const double step_size   = _magnification / steps;
-        const double step_period = (duration / steps) * 1000000;
-
-        CGEventSetDoubleValueField(pinch, kCGEventGesturePinchValue, step_size);
-
-        for (size_t i = 0; i < steps; i++) {
-            POST(pinch);
-            usleep(step_period);
-        }
+    const mouse_gesture_steps_t pinch = {
+        .type     = kCGGestureTypePinch,
+        .total    = _magnification,
+        .duration = duration,
+        .fps      = fps
+    };
+    OPERATION_BEGIN();
+    mouse_gesture(point, FRAMES(HOLD), mouse_gesture_steps_body, &pinch);
+    OPERATION_END(kMouseStatsPinch);
+}
 
-        CFRelease(pinch);
-    });
+void
+mouse_pinch4(const CGPinchDirection direction,
+             const double magnification,
+             const CGPoint point,
+             const double duration)
+{
+    mouse_pinch5(direction, magnification, point, duration, device->frame_rate);
 }
 
 void
@@ -590,10 +1548,11 @@ mouse_pinch(const CGPinchDirection direction)
 }
 
 void
-mouse_rotate3(const CGRotateDirection direction,
+mouse_rotate4(const CGRotateDirection direction,
 	      const double angle,
 	      const CGPoint point,
-	      const double duration)
+	      const double duration,
+	      const double fps)
 {
     double _angle = angle;
 
@@ -607,28 +1566,24 @@ mouse_rotate3(const CGRotateDirection direction,
         return;
     }
 
-    mouse_gesture(point, (FPS / 10), ^(void)
-    {
-        NEW_GESTURE(rotation);
-        CGEventSetIntegerValueField(rotation,
-                                    kCGEventGestureType,
-                                    kCGGestureTypeRotation);
-
-        const size_t steps       = FPS / duration;
-        const double step_size   = _angle / steps;
-        const double step_period = (duration / steps) * 1000000;
-
-        CGEventSetDoubleValueField(rotation,
-                                   kCGEventGestureRotationValue,
-                                   step_size);
-
-        for (size_t i = 0; i < steps; i++) {
-            POST(rotation);
-            usleep(step_period);
-        }
+    const mouse_gesture_steps_t rotation = {
+        .type     = kCGGestureTypeRotation,
+        .total    = _angle,
+        .duration = duration,
+        .fps      = fps
+    };
+    OPERATION_BEGIN();
+    mouse_gesture(point, FRAMES(HOLD), mouse_gesture_steps_body, &rotation);
+    OPERATION_END(kMouseStatsRotate);
+}
 
-        CFRelease(rotation);
-    });
+void
+mouse_rotate3(const CGRotateDirection direction,
+              const double angle,
+              const CGPoint point,
+              const double duration)
+{
+    mouse_rotate4(direction, angle, point, duration, device->frame_rate);
 }
 
 void
@@ -6,30 +6,157 @@
 //  Copyright (c) 2012 Mark Rada. All rights reserved.
 //
 
-#include <ApplicationServices/ApplicationServices.h>
-#include "CGEventAdditions.h"
+#ifndef MOUSER_H
+#define MOUSER_H
+
+#include "backend.h"
+#include "trace.h"
+#include "profile.h"
+#include "stats.h"
+#include <stdbool.h>
 
 typedef unsigned int uint_t;
 
+static const double DEFAULT_DURATION      = 0.2;  // seconds
+static const double DEFAULT_MAGNIFICATION = 1.0;  // factor
+static const double DEFAULT_FPS           = 240;  // frames per second
+static const double MAX_FPS               = 1000; // frames per second
+static const double HOLD                  = 0.1;  // seconds a button or gesture is held
+static const double MAGNIFY_HOLD          = 0.5;  // seconds
+static const double MAX_TIMEOUT           = 86400; // seconds an operation may be given
+
+typedef struct {
+    size_t created; // events allocated by the backend
+    size_t posted;  // events posted
+    size_t dropped; // events posted that the backend could not deliver
+} mouse_event_counts_t;
+
+mouse_event_counts_t mouse_event_counts(void);
+
+// Animations and holds in progress on a thread stop at their next frame
+// once the token installed on that thread has been cancelled, once its
+// parent has been cancelled, or once its deadline has passed; tokens may
+// be cancelled from any thread. Operations that hold a button down still
+// let go of it when they are stopped early.
+typedef struct mouse_token {
+    bool                      cancelled;
+    bool                      timed_out; // set once the deadline has passed
+    uint64_t                  deadline;  // as given by mouse_now(), or 0 for none
+    double                    progress;  // fraction of the animation that was posted
+    const struct mouse_token* parent;    // may be NULL
+} mouse_token_t;
+
+uint64_t mouse_now(void); // monotonic nanoseconds
+
+// A device is one pointer with a backend instance, a frame rate, motion
+// profile, clock and statistics of its own. Each thread posts through the
+// device installed on it, the default device unless another one is, and
+// every function below that does not take a device works on that one;
+// threads may drive different devices at the same time.
+typedef struct mouse_device mouse_device_t;
+
+// Returns NULL if the backend could not be opened
+mouse_device_t* mouse_device_new(const mouse_backend_t* const backend);
+mouse_device_t* mouse_device_retain(mouse_device_t* const device);
+void            mouse_device_release(mouse_device_t* const device);
+
+// Other parts of the library can hang state of their own off a device,
+// such as the thread that dispatch.c posts its jobs from, which `detach`
+// is given back once the device is freed. A device holds one attachment;
+// returns the one already attached if another thread got there first.
+void* mouse_device_attach(mouse_device_t* const device,
+                          void* const attachment,
+                          void (* const detach)(void* const attachment));
+void* mouse_device_attachment(mouse_device_t* const device);
+
+// NULL installs the default device; returns the previous device
+mouse_device_t* mouse_set_device(mouse_device_t* const device);
+mouse_device_t* mouse_device(void);
+mouse_device_t* mouse_default_device(void);
+
+void mouse_device_stats(mouse_stats_t* const snapshot);
+void mouse_device_reset_stats(void);
+
+// The virtual screen of the current device, or NULL if it does not post
+// to the memory backend
+mouse_memory_t* mouse_memory(void);
+
+mouse_token_t* mouse_set_token(mouse_token_t* const token); // returns the previous token
+void mouse_token_cancel(mouse_token_t* const token);
+bool mouse_token_cancelled(const mouse_token_t* const token);
+void mouse_token_set_timeout(mouse_token_t* const token, const double seconds);
+bool mouse_token_stopped(mouse_token_t* const token);
+
 CGPoint mouse_current_position(void);
 
+// Only to be changed while no operations are running on the device;
+// returns false, and keeps the current backend, if the new one could not
+// be opened
+bool                   mouse_set_backend(const mouse_backend_t* const backend);
+const mouse_backend_t* mouse_backend(void);
+
+void   mouse_set_fps(const double fps);
+double mouse_fps(void);
+
+void mouse_set_dead_reckoning(const bool enabled);
+bool mouse_dead_reckoning(void);
+
+// With the clock warped, mouse_now() stands still until the core waits
+// for a frame, and then jumps to when the frame is due instead of
+// sleeping, so operations run as fast as they can post while every event
+// is still stamped with when it would have been posted. Timeouts are
+// measured on the warped clock too. Only to be changed while no
+// operations are running.
+void mouse_set_time_warp(const bool enabled);
+bool mouse_time_warp(void);
+
+// When an animation falls at least two frames behind its schedule, the
+// moves it missed are skipped so that it still ends on time; button
+// transitions and scrolls are never skipped. On by default, and counted
+// as frames_coalesced in the stats.
+void mouse_set_coalesce(const bool enabled);
+bool mouse_coalesce(void);
+
+void            mouse_set_profile(const mouse_profile_t profile);
+mouse_profile_t mouse_profile(void);
+
 void mouse_move_to(const CGPoint point);
 void mouse_move_to2(const CGPoint point, const double duration);
+void mouse_move_to3(const CGPoint point, const double duration, const double fps);
+void mouse_move_to4(const CGPoint point, const double duration, const double fps, const mouse_profile_t profile);
+
+// `path` is `points` packed pairs of native float64 x and y co-ordinates,
+// which need not be aligned; the cursor is moved along the path at an
+// even pace so that it reaches the last point after `duration` seconds
+void mouse_follow_path2(const void* const path, const size_t points, const double duration);
+void mouse_follow_path3(const void* const path, const size_t points, const double duration, const double fps);
+
+// Posts each event in the trace when it is due, relative to the first
+void mouse_replay(const mouse_trace_t* const trace);
 
 void mouse_drag_to(const CGPoint point);
 void mouse_drag_to2(const CGPoint point, const double duration);
+void mouse_drag_to3(const CGPoint point, const double duration, const double fps);
+void mouse_drag_to4(const CGPoint point, const double duration, const double fps, const mouse_profile_t profile);
 
 void mouse_scroll(const int amount);
 void mouse_scroll2(const int amount, const CGScrollEventUnit units);
 void mouse_scroll3(const int amount, const CGScrollEventUnit units, const double duration);
+void mouse_scroll4(const int amount, const CGScrollEventUnit units, const double duration, const double fps);
 
 void mouse_horizontal_scroll(const int amount);
 void mouse_horizontal_scroll2(const int amount, const CGScrollEventUnit units);
 void mouse_horizontal_scroll3(const int amount, const CGScrollEventUnit units, const double duration);
+void mouse_horizontal_scroll4(const int amount, const CGScrollEventUnit units, const double duration, const double fps);
 
+// Variants that take `sleep_frames` hold the button down for that many
+// frames at the current frame rate before they return; the others hold
+// it for HOLD seconds. Before the frame rate could be changed, the hold
+// was counted in quanta of 1/240 of a second, which is only the same at
+// the default frame rate.
 void mouse_click_down(void);
 void mouse_click_down2(const CGPoint point);
-void mouse_click_down3(const CGPoint point, const uint_t sleep_quanta);
+void mouse_click_down3(const CGPoint point, const uint_t sleep_frames);
 
 void mouse_click_up(void);
 void mouse_click_up2(const CGPoint point);
@@ -39,25 +166,25 @@ void mouse_click2(const CGPoint point);
 
 void mouse_secondary_click_down(void);
 void mouse_secondary_click_down2(const CGPoint point);
-void mouse_secondary_click_down3(const CGPoint point, const uint_t sleep_quanta);
+void mouse_secondary_click_down3(const CGPoint point, const uint_t sleep_frames);
 
 void mouse_secondary_click_up(void);
 void mouse_secondary_click_up2(const CGPoint point);
 
 void mouse_secondary_click(void);
 void mouse_secondary_click2(const CGPoint point);
-void mouse_secondary_click3(const CGPoint point, const uint_t sleep_quanta);
+void mouse_secondary_click3(const CGPoint point, const uint_t sleep_frames);
 
 void mouse_arbitrary_click_down(const CGEventMouseSubtype button);
 void mouse_arbitrary_click_down2(const CGEventMouseSubtype button, const CGPoint point);
-void mouse_arbitrary_click_down3(const CGEventMouseSubtype button, const CGPoint point, const uint_t sleep_quanta);
+void mouse_arbitrary_click_down3(const CGEventMouseSubtype button, const CGPoint point, const uint_t sleep_frames);
 
 void mouse_arbitrary_click_up(const CGEventMouseSubtype button);
 void mouse_arbitrary_click_up2(const CGEventMouseSubtype button, const CGPoint point);
 
 void mouse_arbitrary_click(const CGEventMouseSubtype button);
 void mouse_arbitrary_click2(const CGEventMouseSubtype button, const CGPoint point);
-void mouse_arbitrary_click3(const CGEventMouseSubtype button, const CGPoint point, const uint_t sleep_quanta);
+void mouse_arbitrary_click3(const CGEventMouseSubtype button, const CGPoint point, const uint_t sleep_frames);
 
 void mouse_middle_click(void);
 void mouse_middle_click2(const CGPoint point);
@@ -71,6 +198,16 @@ void mouse_double_click2(const CGPoint point);
 void mouse_triple_click(void);
 void mouse_triple_click2(const CGPoint point);
 
+// Clicks each of `points` packed pairs of co-ordinates, laid out as for
+// mouse_follow_path3(), holding `button` down for `hold` seconds and then
+// waiting `interval` seconds before the next click; clicks are due at
+// fixed times from the first, so time spent posting does not add up
+void mouse_click_all(const void* const points,
+                     const size_t count,
+                     const CGEventMouseSubtype button,
+                     const double hold,
+                     const double interval);
+
 void mouse_smart_magnify(void);
 void mouse_smart_magnify2(const CGPoint point);
 
@@ -81,7 +218,11 @@ void mouse_pinch(const CGPinchDirection direction);
 void mouse_pinch2(const CGPinchDirection direction, const double magnification);
 void mouse_pinch3(const CGPinchDirection direction, const double magnification, const CGPoint point);
 void mouse_pinch4(const CGPinchDirection direction, const double magnification, const CGPoint point, const double duration);
+void mouse_pinch5(const CGPinchDirection direction, const double magnification, const CGPoint point, const double duration, const double fps);
 
 void mouse_rotate(const CGRotateDirection direction, const double angle);
 void mouse_rotate2(const CGRotateDirection direction, const double angle, const CGPoint point);
 void mouse_rotate3(const CGRotateDirection direction, const double angle, const CGPoint point, const double duration);
+void mouse_rotate4(const CGRotateDirection direction, const double angle, const CGPoint point, const double duration, const double fps);
+
+#endif
@@ -0,0 +1,170 @@
+//
+//  plan.c
+//  MRMouse
+//
+//  The cache is a small direct mapped table; a plan that collides with
+//  another simply replaces it, and lives on for as long as animations
+//  are still using it.
+//
+
+#include "plan.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_SIZE 128 // must be a power of two
+
+// the most frames a plan can have before its size overflows
+#define MAX_STEPS (((SIZE_MAX - sizeof(mouse_plan_t)) / sizeof(CGPoint)) - 1)
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static mouse_plan_t*  cache[CACHE_SIZE];
+
+// FNV-1a over the key; keys are zeroed before being filled in, so the
+// padding hashes and compares the same every time
+static
+size_t
+mouse_plan_hash(const mouse_plan_key_t* const key)
+{
+    const unsigned char* const bytes = (const unsigned char*)key;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(mouse_plan_key_t); i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return (size_t)(hash & (CACHE_SIZE - 1));
+}
+
+// must be called with the lock held
+static
+void
+mouse_plan_unref(mouse_plan_t* const plan)
+{
+    if (!--plan->references)
+        free(plan);
+}
+
+static
+size_t
+mouse_plan_steps(const mouse_plan_key_t* const key)
+{
+    // saturates instead of converting an out of range double to size_t,
+    // so that mouse_plan_make() can turn it down
+    const double steps = round(key->duration * key->fps);
+    if (!(steps >= 1))
+        return 1;
+    return steps < (double)MAX_STEPS ? (size_t)steps : SIZE_MAX;
+}
+
+// The fractions are worked out into the front of the offsets, which hold
+// twice as many doubles, and spread out from the last frame back, so each
+// fraction is read before the offset written over it
+static
+mouse_plan_t*
+mouse_plan_fill(mouse_plan_t* const plan,
+                const mouse_plan_key_t* const key,
+                const size_t steps)
+{
+    double* const fractions = (double*)plan->offsets;
+    mouse_profile_plan(key->profile, fractions, steps);
+    for (size_t i = steps + 1; i-- > 0;) {
+        const double fraction = fractions[i];
+        plan->offsets[i] = CGPointMake(key->dx * fraction, key->dy * fraction);
+    }
+
+    plan->key        = *key;
+    plan->steps      = steps;
+    plan->references = 1;
+    return plan;
+}
+
+static
+mouse_plan_t*
+mouse_plan_make(const mouse_plan_key_t* const key)
+{
+    const size_t steps = mouse_plan_steps(key);
+    if (steps > MAX_STEPS)
+        return NULL;
+    mouse_plan_t* const plan = malloc(sizeof(mouse_plan_t) + ((steps + 1) * sizeof(CGPoint)));
+    return plan ? mouse_plan_fill(plan, key, steps) : NULL;
+}
+
+static
+mouse_plan_key_t
+mouse_plan_key(const CGPoint delta,
+               const double duration,
+               const double fps,
+               const mouse_profile_t profile)
+{
+    mouse_plan_key_t key;
+    memset(&key, 0, sizeof(key));
+    key.dx       = delta.x;
+    key.dy       = delta.y;
+    key.duration = duration;
+    key.fps      = fps;
+    key.profile  = profile;
+    return key;
+}
+
+mouse_plan_t*
+mouse_plan_get(const CGPoint delta,
+               const double duration,
+               const double fps,
+               const mouse_profile_t profile,
+               bool* const cached)
+{
+    const mouse_plan_key_t key = mouse_plan_key(delta, duration, fps, profile);
+    const size_t slot = mouse_plan_hash(&key);
+
+    pthread_mutex_lock(&lock);
+    mouse_plan_t* plan = cache[slot];
+    if (plan && !memcmp(&plan->key, &key, sizeof(key))) {
+        plan->references++;
+        pthread_mutex_unlock(&lock);
+        if (cached)
+            *cached = true;
+        return plan;
+    }
+    pthread_mutex_unlock(&lock);
+
+    // planning happens outside of the lock, since long animations have
+    // a lot of frames to plan
+    plan = mouse_plan_make(&key);
+    if (cached)
+        *cached = false;
+    if (!plan)
+        return NULL;
+
+    pthread_mutex_lock(&lock);
+    if (cache[slot])
+        mouse_plan_unref(cache[slot]);
+    cache[slot] = plan;
+    plan->references++;
+    pthread_mutex_unlock(&lock);
+
+    return plan;
+}
+
+mouse_plan_t*
+mouse_plan_fallback(mouse_plan_fallback_t* const fallback,
+                    const CGPoint delta,
+                    const double duration,
+                    const double fps,
+                    const mouse_profile_t profile)
+{
+    mouse_plan_key_t key = mouse_plan_key(delta, duration, fps, profile);
+    size_t steps = mouse_plan_steps(&key);
+    if (steps > MOUSE_PLAN_FALLBACK_STEPS) {
+        steps   = MOUSE_PLAN_FALLBACK_STEPS;
+        key.fps = steps / duration;
+    }
+    return mouse_plan_fill(&fallback->plan, &key, steps);
+}
+
+void
+mouse_plan_release(mouse_plan_t* const plan)
+{
+    pthread_mutex_lock(&lock);
+    mouse_plan_unref(plan);
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,63 @@
+//
+//  plan.h
+//  MRMouse
+//
+//  A plan is everything about a cursor animation that can be worked out
+//  before the first frame is posted: how many frames there are and where
+//  the cursor should be at each one, relative to where it started. Plans
+//  only depend on how far the cursor is going and how, so they are cached
+//  and shared between animations that cover the same ground.
+//
+
+#ifndef PLAN_H
+#define PLAN_H
+
+#include "cgtypes.h"
+#include <stdbool.h>
+#include "profile.h"
+
+typedef struct {
+    double          dx;
+    double          dy;
+    double          duration; // seconds
+    double          fps;
+    mouse_profile_t profile;
+} mouse_plan_key_t;
+
+typedef struct mouse_plan {
+    mouse_plan_key_t key;
+    size_t         steps;
+    unsigned int   references;
+    CGPoint        offsets[]; // from the starting point, for frames 0 through `steps`
+} mouse_plan_t;
+
+// Returns a shared plan, which must be given back to mouse_plan_release(),
+// or NULL if the plan is too big to allocate; `cached` may be NULL,
+// otherwise it says whether the plan was already made
+mouse_plan_t* mouse_plan_get(const CGPoint delta,
+                             const double duration,
+                             const double fps,
+                             const mouse_profile_t profile,
+                             bool* const cached);
+
+void mouse_plan_release(mouse_plan_t* const plan);
+
+// Room for a plan of up to MOUSE_PLAN_FALLBACK_STEPS frames, which can
+// live on the stack for when there is no memory for a plan of its own
+#define MOUSE_PLAN_FALLBACK_STEPS 240
+
+typedef union {
+    mouse_plan_t plan;
+    char         bytes[sizeof(mouse_plan_t) + ((MOUSE_PLAN_FALLBACK_STEPS + 1) * sizeof(CGPoint))];
+} mouse_plan_fallback_t;
+
+// Plans into `fallback` without allocating or caching anything, and is
+// not released. An animation with more frames than fit runs at a lower
+// frame rate, over the same duration.
+mouse_plan_t* mouse_plan_fallback(mouse_plan_fallback_t* const fallback,
+                                  const CGPoint delta,
+                                  const double duration,
+                                  const double fps,
+                                  const mouse_profile_t profile);
+
+#endif
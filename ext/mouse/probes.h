@@ -0,0 +1,67 @@
+//
+//  probes.h
+//  MRMouse
+//
+//  Static probes for bpftrace, perf or DTrace, compiled in when the
+//  extension is configured with `--enable-usdt` and the system has
+//  <sys/sdt.h>. Otherwise every probe compiles to nothing.
+//
+//  A probe is a single nop in the code until something attaches to it.
+//  Probes whose arguments cost something to work out check
+//  MOUSE_PROBE_ENABLED first; on Linux that reads a semaphore that the
+//  tracer sets while it is attached.
+//
+//  mouse:post(type, x, y)                      an event is about to be posted
+//  mouse:sleep__start(deadline)                about to sleep until `deadline`, as given by mouse_now()
+//  mouse:sleep__done(deadline)
+//  mouse:operation__start(function, depth)     a public function in mouser.h started
+//  mouse:operation__done(function, depth, ns)  `depth` is how many operations it is nested in
+//
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef MOUSE_USDT
+
+#ifdef __linux__
+#define _SDT_HAS_SEMAPHORES 1
+#endif
+#include <sys/sdt.h>
+
+#define MOUSE_PROBE0(name)          DTRACE_PROBE(mouse, name)
+#define MOUSE_PROBE1(name, a)       DTRACE_PROBE1(mouse, name, a)
+#define MOUSE_PROBE2(name, a, b)    DTRACE_PROBE2(mouse, name, a, b)
+#define MOUSE_PROBE3(name, a, b, c) DTRACE_PROBE3(mouse, name, a, b, c)
+
+#ifdef _SDT_HAS_SEMAPHORES
+// Every probe needs a semaphore in the .probes section, which is where
+// tracers look for it; mouser.c defines them
+#define MOUSE_SEMAPHORE(name) mouse_##name##_semaphore
+#define MOUSE_SEMAPHORES(declare)               \
+    declare(post);                              \
+    declare(sleep__start);                      \
+    declare(sleep__done);                       \
+    declare(operation__start);                  \
+    declare(operation__done)
+#define MOUSE_DECLARE_SEMAPHORE(name) extern unsigned short MOUSE_SEMAPHORE(name)
+#define MOUSE_DEFINE_SEMAPHORE(name) \
+    unsigned short MOUSE_SEMAPHORE(name) __attribute__ ((section (".probes"))) = 0
+MOUSE_SEMAPHORES(MOUSE_DECLARE_SEMAPHORE);
+#define MOUSE_PROBE_ENABLED(name) __builtin_expect(MOUSE_SEMAPHORE(name) != 0, 0)
+#else
+#define MOUSE_PROBE_ENABLED(name) 1
+#endif
+
+#else
+
+// arguments are still evaluated, so they never look unused, but they
+// are cheap enough to be optimised away
+#define MOUSE_PROBE0(name)          ((void)0)
+#define MOUSE_PROBE1(name, a)       ((void)(a))
+#define MOUSE_PROBE2(name, a, b)    ((void)(a), (void)(b))
+#define MOUSE_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+#define MOUSE_PROBE_ENABLED(name)   0
+
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+//
+//  profile.c
+//  MRMouse
+//
+//  Each profile is a loop of its own so that the compiler can vectorize
+//  it, rather than switching on the profile for every frame.
+//
+
+#include "profile.h"
+#include <math.h>
+
+// Length of the speed up and slow down phases of the S-curve, as a
+// fraction of the whole animation
+#define RAMP 0.25
+
+// The speed ramps up along half a cosine wave, so acceleration changes
+// smoothly too; integrating that gives the distance covered during the
+// ramp, and the cruise speed is picked so that the distance comes to 1
+static
+double
+mouse_profile_s_curve(const double t)
+{
+    const double cruise = 1 / (1 - RAMP);
+    const double      u = t > 0.5 ? 1 - t : t;
+    const double   part = u < RAMP ?
+        cruise * ((u / 2) - ((RAMP / (2 * M_PI)) * sin((M_PI * u) / RAMP))) :
+        cruise * ((RAMP / 2) + (u - RAMP));
+    return t > 0.5 ? 1 - part : part;
+}
+
+void
+mouse_profile_plan(const mouse_profile_t profile,
+                   double* const plan,
+                   const size_t steps)
+{
+    const double frames = (double)steps;
+
+    switch (profile) {
+    case kMouseProfileEaseInOut:
+        for (size_t i = 0; i <= steps; i++) {
+            const double t = i / frames;
+            plan[i] = t * t * (3 - (2 * t));
+        }
+        break;
+    case kMouseProfileMinimumJerk:
+        for (size_t i = 0; i <= steps; i++) {
+            const double t = i / frames;
+            plan[i] = t * t * t * (10 + (t * ((6 * t) - 15)));
+        }
+        break;
+    case kMouseProfileSCurve:
+        for (size_t i = 0; i <= steps; i++)
+            plan[i] = mouse_profile_s_curve(i / frames);
+        break;
+    case kMouseProfileLinear:
+    default:
+        for (size_t i = 0; i <= steps; i++)
+            plan[i] = i / frames;
+        break;
+    }
+
+    // rounding must not leave the cursor short of where it was going
+    plan[steps] = 1;
+}
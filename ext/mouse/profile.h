@@ -0,0 +1,29 @@
+//
+//  profile.h
+//  MRMouse
+//
+//  A motion profile decides how far along its path an animation should be
+//  at each frame. Apps that look at how fast the cursor is moving, such as
+//  when deciding whether a drag has started, can miss the abrupt start and
+//  stop of a linear animation.
+//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+
+typedef enum {
+    kMouseProfileLinear,      // constant speed
+    kMouseProfileEaseInOut,   // cubic smoothstep
+    kMouseProfileMinimumJerk, // quintic, like a hand reaching for a target
+    kMouseProfileSCurve,      // speeds up and slows down over the first and last quarters
+} mouse_profile_t;
+
+// Fills `plan[0]` through `plan[steps]` with the fraction of the distance
+// to cover by each frame, going from 0 to 1
+void mouse_profile_plan(const mouse_profile_t profile,
+                        double* const plan,
+                        const size_t steps);
+
+#endif
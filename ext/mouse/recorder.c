@@ -0,0 +1,176 @@
+//
+//  recorder.c
+//  MRMouse
+//
+//  The ring is a bounded multi-producer queue: each slot carries a
+//  sequence number that says whether it is ready to be written for a given
+//  lap of the ring or ready to be read, so producers only ever contend on
+//  the compare and swap that claims a position.
+//
+
+#include "recorder.h"
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MASK (MOUSE_RECORDER_CAPACITY - 1)
+#define FLUSH_BATCH 1024
+#define FLUSH_INTERVAL 10000000 // nanoseconds
+
+typedef struct {
+    size_t               sequence;
+    mouse_trace_record_t record;
+} mouse_recorder_slot_t;
+
+bool mouse_recording = false;
+
+static mouse_recorder_slot_t slots[MOUSE_RECORDER_CAPACITY];
+static size_t write_position = 0;
+static size_t read_position  = 0;
+static size_t dropped        = 0;
+static bool   initialized    = false;
+
+// Consumers take turns; producers never touch this lock
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t flusher;
+static bool      flushing = false;
+static bool      stop_flushing = false;
+static int       flush_fd = -1;
+
+void
+mouse_recorder_start()
+{
+    pthread_mutex_lock(&drain_lock);
+    if (!initialized) {
+        for (size_t i = 0; i < MOUSE_RECORDER_CAPACITY; i++)
+            slots[i].sequence = i;
+        initialized = true;
+    }
+    pthread_mutex_unlock(&drain_lock);
+    __atomic_store_n(&mouse_recording, true, __ATOMIC_RELEASE);
+}
+
+void
+mouse_recorder_stop()
+{
+    __atomic_store_n(&mouse_recording, false, __ATOMIC_RELEASE);
+}
+
+bool
+mouse_recorder_push(const mouse_trace_record_t* const record)
+{
+    size_t position = __atomic_load_n(&write_position, __ATOMIC_RELAXED);
+    mouse_recorder_slot_t* slot;
+
+    for (;;) {
+        slot = &slots[position & MASK];
+        const size_t   sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        const intptr_t     lead = (intptr_t)sequence - (intptr_t)position;
+
+        if (!lead) {
+            if (__atomic_compare_exchange_n(&write_position, &position, position + 1,
+                                            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (lead < 0) {
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        else {
+            position = __atomic_load_n(&write_position, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->record = *record;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+size_t
+mouse_recorder_drain(mouse_trace_record_t* const records, const size_t max)
+{
+    size_t count = 0;
+
+    pthread_mutex_lock(&drain_lock);
+    while (initialized && count < max) {
+        mouse_recorder_slot_t* const slot = &slots[read_position & MASK];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != read_position + 1)
+            break; // empty, or the producer has not finished writing it yet
+
+        records[count++] = slot->record;
+        __atomic_store_n(&slot->sequence, read_position + MOUSE_RECORDER_CAPACITY, __ATOMIC_RELEASE);
+        read_position++;
+    }
+    pthread_mutex_unlock(&drain_lock);
+
+    return count;
+}
+
+size_t
+mouse_recorder_dropped()
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+static
+void
+mouse_recorder_flush(mouse_trace_record_t* const batch)
+{
+    size_t count;
+    while ((count = mouse_recorder_drain(batch, FLUSH_BATCH)))
+        if (!mouse_trace_write(flush_fd, batch, count))
+            break;
+}
+
+static
+void*
+mouse_recorder_flusher(void* const unused __attribute__ ((unused)))
+{
+    static mouse_trace_record_t batch[FLUSH_BATCH];
+    const struct timespec interval = { .tv_sec = 0, .tv_nsec = FLUSH_INTERVAL };
+
+    while (!__atomic_load_n(&stop_flushing, __ATOMIC_ACQUIRE)) {
+        mouse_recorder_flush(batch);
+        nanosleep(&interval, NULL);
+    }
+    mouse_recorder_flush(batch);
+
+    return NULL;
+}
+
+int
+mouse_recorder_flush_to(const char* const path)
+{
+    if (flushing)
+        mouse_recorder_stop_flushing();
+
+    flush_fd = mouse_trace_create(path);
+    if (flush_fd < 0)
+        return errno;
+
+    stop_flushing = false;
+    const int error = pthread_create(&flusher, NULL, mouse_recorder_flusher, NULL);
+    if (error) {
+        close(flush_fd);
+        flush_fd = -1;
+        return error;
+    }
+
+    flushing = true;
+    return 0;
+}
+
+void
+mouse_recorder_stop_flushing()
+{
+    if (!flushing)
+        return;
+
+    __atomic_store_n(&stop_flushing, true, __ATOMIC_RELEASE);
+    pthread_join(flusher, NULL);
+    close(flush_fd);
+    flush_fd = -1;
+    flushing = false;
+}
@@ -0,0 +1,44 @@
+//
+//  recorder.h
+//  MRMouse
+//
+//  The recorder keeps a copy of every event posted while it is recording
+//  in a fixed size ring, without taking locks, making system calls or
+//  allocating memory on the posting thread. Records are taken out of the
+//  ring by draining it, or by a background thread that appends them to a
+//  trace file. If the ring fills up, new records are dropped and counted.
+//
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "trace.h"
+
+#define MOUSE_RECORDER_CAPACITY 65536 // records, must be a power of two
+
+extern bool mouse_recording;
+
+#define MOUSE_RECORDING __atomic_load_n(&mouse_recording, __ATOMIC_ACQUIRE)
+
+void mouse_recorder_start(void);
+void mouse_recorder_stop(void);
+
+// Safe to call from any number of threads at once; returns false if the
+// record was dropped because the ring is full
+bool mouse_recorder_push(const mouse_trace_record_t* const record);
+
+// Copies up to `max` of the oldest records out of the ring, returning how
+// many were copied
+size_t mouse_recorder_drain(mouse_trace_record_t* const records, const size_t max);
+
+size_t mouse_recorder_dropped(void);
+
+// Starts a thread that appends records to a new trace at `path` as they
+// come in; returns 0 or an errno value
+int  mouse_recorder_flush_to(const char* const path);
+
+// Writes out what is left in the ring, then stops the flushing thread
+// and closes its trace
+void mouse_recorder_stop_flushing(void);
+
+#endif
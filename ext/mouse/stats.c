@@ -0,0 +1,151 @@
+//
+//  stats.c
+//  MRMouse
+//
+//  Buckets are laid out like an HDR histogram: values below 32 are
+//  counted exactly, then each power of two is split into 16 buckets.
+//
+
+#include "stats.h"
+#include <string.h>
+
+#define SUB_BITS 4
+#define SUB      (1 << SUB_BITS)       // buckets per power of two
+#define EXACT    (SUB << 1)            // values counted exactly
+
+static const char* const names[kMouseStatsOperations] = {
+    [kMouseStatsMoveTo]           = "move_to",
+    [kMouseStatsDragTo]           = "drag_to",
+    [kMouseStatsFollowPath]       = "follow_path",
+    [kMouseStatsReplay]           = "replay",
+    [kMouseStatsScroll]           = "scroll",
+    [kMouseStatsHorizontalScroll] = "horizontal_scroll",
+    [kMouseStatsClickDown]        = "click_down",
+    [kMouseStatsClickUp]          = "click_up",
+    [kMouseStatsClick]            = "click",
+    [kMouseStatsMultiClick]       = "multi_click",
+    [kMouseStatsClickAll]         = "click_all",
+    [kMouseStatsSmartMagnify]     = "smart_magnify",
+    [kMouseStatsSwipe]            = "swipe",
+    [kMouseStatsPinch]            = "pinch",
+    [kMouseStatsRotate]           = "rotate",
+};
+
+const char*
+mouse_stats_operation_name(const mouse_stats_operation_t operation)
+{
+    return names[operation];
+}
+
+static
+size_t
+mouse_histogram_bucket(const uint64_t value)
+{
+    if (value < EXACT)
+        return (size_t)value;
+
+    // the top SUB_BITS + 1 bits of the value pick the bucket
+    const int   magnitude = 63 - __builtin_clzll(value);
+    const size_t mantissa = (size_t)(value >> (magnitude - SUB_BITS)) - SUB;
+    const size_t   bucket = EXACT + ((size_t)(magnitude - SUB_BITS - 1) * SUB) + mantissa;
+    return bucket < MOUSE_HISTOGRAM_BUCKETS ? bucket : MOUSE_HISTOGRAM_BUCKETS - 1;
+}
+
+uint64_t
+mouse_histogram_bucket_limit(const size_t bucket)
+{
+    if (bucket < EXACT)
+        return bucket;
+    if (bucket >= MOUSE_HISTOGRAM_BUCKETS - 1)
+        return UINT64_MAX;
+
+    const size_t     magnitude = ((bucket - EXACT) / SUB) + SUB_BITS + 1;
+    const uint64_t    mantissa = ((bucket - EXACT) % SUB) + SUB;
+    return ((mantissa + 1) << (magnitude - SUB_BITS)) - 1;
+}
+
+void
+mouse_histogram_record(mouse_histogram_t* const histogram, const uint64_t value)
+{
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->buckets[mouse_histogram_bucket(value)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&histogram->max, &max, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+uint64_t
+mouse_histogram_percentile(const mouse_histogram_t* const histogram,
+                           const double percentile)
+{
+    if (!histogram->count)
+        return 0;
+
+    const double wanted = (percentile / 100) * histogram->count;
+    uint64_t       seen = 0;
+    for (size_t bucket = 0; bucket < MOUSE_HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen && seen >= wanted) {
+            const uint64_t limit = mouse_histogram_bucket_limit(bucket);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+void
+mouse_stats_record_lateness(mouse_stats_t* const stats, const uint64_t nanoseconds)
+{
+    mouse_histogram_record(&stats->lateness, nanoseconds);
+}
+
+void
+mouse_stats_record_operation(mouse_stats_t* const stats,
+                             const mouse_stats_operation_t operation,
+                             const uint64_t nanoseconds,
+                             const uint64_t frames_planned,
+                             const uint64_t frames_posted,
+                             const uint64_t frames_coalesced)
+{
+    mouse_operation_stats_t* const op = &stats->operations[operation];
+    mouse_histogram_record(&op->wall_time, nanoseconds);
+    __atomic_fetch_add(&op->frames_planned, frames_planned, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&op->frames_posted,  frames_posted,  __ATOMIC_RELAXED);
+    __atomic_fetch_add(&op->frames_coalesced, frames_coalesced, __ATOMIC_RELAXED);
+}
+
+static
+void
+mouse_histogram_copy(mouse_histogram_t* const to, const mouse_histogram_t* const from)
+{
+    to->count = __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+    to->sum   = __atomic_load_n(&from->sum,   __ATOMIC_RELAXED);
+    to->max   = __atomic_load_n(&from->max,   __ATOMIC_RELAXED);
+    for (size_t i = 0; i < MOUSE_HISTOGRAM_BUCKETS; i++)
+        to->buckets[i] = __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+}
+
+void
+mouse_stats_snapshot(const mouse_stats_t* const stats, mouse_stats_t* const snapshot)
+{
+    mouse_histogram_copy(&snapshot->lateness, &stats->lateness);
+    for (size_t i = 0; i < kMouseStatsOperations; i++) {
+        mouse_operation_stats_t* const       to = &snapshot->operations[i];
+        const mouse_operation_stats_t* const from = &stats->operations[i];
+        mouse_histogram_copy(&to->wall_time, &from->wall_time);
+        to->frames_planned = __atomic_load_n(&from->frames_planned, __ATOMIC_RELAXED);
+        to->frames_posted  = __atomic_load_n(&from->frames_posted,  __ATOMIC_RELAXED);
+        to->frames_coalesced = __atomic_load_n(&from->frames_coalesced, __ATOMIC_RELAXED);
+    }
+}
+
+// Anything recorded while resetting may be partly lost, which is fine
+// for statistics
+void
+mouse_stats_reset(mouse_stats_t* const stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
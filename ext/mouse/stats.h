@@ -0,0 +1,86 @@
+//
+//  stats.h
+//  MRMouse
+//
+//  Always on statistics about how well operations kept to their schedule,
+//  kept in histograms with logarithmic buckets so that recording a value
+//  is a few relaxed atomic adds no matter how large the value is. Each
+//  bucket covers a range of values at most 1/16 as wide as its start.
+//  Every device keeps statistics of its own.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Values up to 2^40 nanoseconds (about 18 minutes) get their own bucket,
+// larger values are counted in the last one
+#define MOUSE_HISTOGRAM_BUCKETS 608
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[MOUSE_HISTOGRAM_BUCKETS];
+} mouse_histogram_t;
+
+void mouse_histogram_record(mouse_histogram_t* const histogram, const uint64_t value);
+
+// The largest value that would be counted in `bucket`
+uint64_t mouse_histogram_bucket_limit(const size_t bucket);
+
+// The value that `percentile` percent of recorded values are no greater
+// than, to within the width of a bucket; 0 if nothing was recorded
+uint64_t mouse_histogram_percentile(const mouse_histogram_t* const histogram,
+                                    const double percentile);
+
+typedef enum {
+    kMouseStatsMoveTo,
+    kMouseStatsDragTo,
+    kMouseStatsFollowPath,
+    kMouseStatsReplay,
+    kMouseStatsScroll,
+    kMouseStatsHorizontalScroll,
+    kMouseStatsClickDown,     // with any button
+    kMouseStatsClickUp,
+    kMouseStatsClick,
+    kMouseStatsMultiClick,    // including double and triple clicks
+    kMouseStatsClickAll,
+    kMouseStatsSmartMagnify,
+    kMouseStatsSwipe,
+    kMouseStatsPinch,
+    kMouseStatsRotate,
+    kMouseStatsOperations     // how many kinds of operation there are
+} mouse_stats_operation_t;
+
+typedef struct {
+    mouse_histogram_t wall_time;        // nanoseconds
+    uint64_t          frames_planned;
+    uint64_t          frames_posted;
+    uint64_t          frames_coalesced; // skipped to catch up with the schedule
+} mouse_operation_stats_t;
+
+typedef struct {
+    mouse_histogram_t       lateness; // nanoseconds past each frame's deadline
+    mouse_operation_stats_t operations[kMouseStatsOperations];
+} mouse_stats_t;
+
+const char* mouse_stats_operation_name(const mouse_stats_operation_t operation);
+
+void mouse_stats_record_lateness(mouse_stats_t* const stats, const uint64_t nanoseconds);
+void mouse_stats_record_operation(mouse_stats_t* const stats,
+                                  const mouse_stats_operation_t operation,
+                                  const uint64_t nanoseconds,
+                                  const uint64_t frames_planned,
+                                  const uint64_t frames_posted,
+                                  const uint64_t frames_coalesced);
+
+// Copies the statistics; operations that finish while the copy is being
+// made may be only partly included
+void mouse_stats_snapshot(const mouse_stats_t* const stats, mouse_stats_t* const snapshot);
+void mouse_stats_reset(mouse_stats_t* const stats);
+
+#endif
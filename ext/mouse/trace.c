@@ -0,0 +1,118 @@
+//
+//  trace.c
+//  MRMouse
+//
+
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int
+mouse_trace_open(mouse_trace_t* const trace, const char* const path)
+{
+    memset(trace, 0, sizeof(mouse_trace_t));
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    struct stat info;
+    if (fstat(fd, &info)) {
+        const int error = errno;
+        close(fd);
+        return error;
+    }
+
+    const size_t length = (size_t)info.st_size;
+    if (length < sizeof(mouse_trace_header_t)) {
+        close(fd);
+        return kMouseTraceInvalid;
+    }
+
+    void* const mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int error = errno;
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return error;
+
+    const mouse_trace_header_t* const header = mapping;
+    if (memcmp(header->magic, MOUSE_TRACE_MAGIC, sizeof(header->magic)) ||
+        header->version != MOUSE_TRACE_VERSION ||
+        header->record_size != sizeof(mouse_trace_record_t)) {
+        munmap(mapping, length);
+        return kMouseTraceInvalid;
+    }
+
+    madvise(mapping, length, MADV_SEQUENTIAL);
+
+    trace->mapping = mapping;
+    trace->length  = length;
+    trace->records = (const mouse_trace_record_t*)(header + 1);
+    trace->count   = (length - sizeof(mouse_trace_header_t)) / sizeof(mouse_trace_record_t);
+    return 0;
+}
+
+void
+mouse_trace_discard(const mouse_trace_t* const trace, const size_t records)
+{
+    const size_t page  = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t bytes = sizeof(mouse_trace_header_t) + (records * sizeof(mouse_trace_record_t));
+    const size_t whole = bytes - (bytes % page);
+    if (whole)
+        madvise(trace->mapping, whole, MADV_DONTNEED);
+}
+
+void
+mouse_trace_close(mouse_trace_t* const trace)
+{
+    if (trace->mapping)
+        munmap(trace->mapping, trace->length);
+    memset(trace, 0, sizeof(mouse_trace_t));
+}
+
+int
+mouse_trace_create(const char* const path)
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    mouse_trace_header_t header = {
+        .version     = MOUSE_TRACE_VERSION,
+        .record_size = sizeof(mouse_trace_record_t)
+    };
+    memcpy(header.magic, MOUSE_TRACE_MAGIC, sizeof(header.magic));
+
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+bool
+mouse_trace_write(const int fd,
+                  const mouse_trace_record_t* const records,
+                  const size_t count)
+{
+    const char* bytes = (const char*)records;
+    size_t remaining  = count * sizeof(mouse_trace_record_t);
+
+    while (remaining) {
+        const ssize_t written = write(fd, bytes, remaining);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes     += written;
+        remaining -= (size_t)written;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+//
+//  trace.h
+//  MRMouse
+//
+//  A trace file is a header followed by fixed size records of timestamped
+//  events, so that a file can be appended to as events are recorded and
+//  memory mapped to replay it without reading it all in first. Fields are
+//  stored in the byte order of the host, which is little endian on every
+//  Mac.
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOUSE_TRACE_MAGIC   "MRMTRACE"
+#define MOUSE_TRACE_VERSION 1
+
+typedef struct {
+    char     magic[8];    // MOUSE_TRACE_MAGIC, without a terminator
+    uint32_t version;     // MOUSE_TRACE_VERSION
+    uint32_t record_size; // sizeof(mouse_trace_record_t)
+} mouse_trace_header_t;
+
+// Fields that do not apply to the type of event are zero
+typedef struct {
+    uint64_t timestamp;         // nanoseconds, from any starting point
+    uint16_t type;              // CGEventType, including kCGEventGesture
+    uint16_t button;            // CGMouseButton
+    uint16_t click_state;       // kCGMouseEventClickState
+    uint16_t scroll_units;      // CGScrollEventUnit
+    double   x;
+    double   y;
+    int32_t  scroll_vertical;
+    int32_t  scroll_horizontal;
+    uint16_t gesture_type;      // kCGEventGestureType
+    uint16_t gesture_phase;     // kCGEventGesturePhase
+    uint16_t swipe_direction;   // kCGEventGestureSwipeDirection
+    uint16_t swipe_motion;      // kCGEventGestureSwipeMotion
+    double   gesture_value;     // pinch or rotation value, or swipe progress
+    double   swipe_position;    // along the axis of the swipe motion
+} mouse_trace_record_t;
+
+typedef struct mouse_trace {
+    const mouse_trace_record_t* records;
+    size_t                        count;
+    void*                       mapping;
+    size_t                       length;
+} mouse_trace_t;
+
+enum {
+    kMouseTraceInvalid = -1, // returned when a file is not a trace
+};
+
+// Maps the trace at `path` into memory; returns 0 on success, an errno
+// value, or kMouseTraceInvalid. A partial record at the end of the file,
+// as left by a recording that was cut short, is ignored.
+int  mouse_trace_open(mouse_trace_t* const trace, const char* const path);
+
+// Lets the system reclaim the memory behind the first `records` records,
+// which keeps a long replay from holding on to the whole file
+void mouse_trace_discard(const mouse_trace_t* const trace, const size_t records);
+
+void mouse_trace_close(mouse_trace_t* const trace);
+
+// Creates or truncates the trace at `path` and writes its header; returns
+// a file descriptor to append records to, or -1 and sets errno
+int  mouse_trace_create(const char* const path);
+
+bool mouse_trace_write(const int fd,
+                       const mouse_trace_record_t* const records,
+                       const size_t count);
+
+#endif
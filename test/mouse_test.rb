@@ -1,7 +1,14 @@
 require 'test/helper'
+require 'timeout'
+require 'tempfile'
 
 class MouseTest < MiniTest::Unit::TestCase
 
+  # tests assume that the cursor does not start where they move it to
+  def setup
+    Mouse.move_to [50, 450], 0
+  end
+
   def distance point1, point2
     x = point1.x - point2.x
     y = point1.y - point2.y
@@ -12,6 +19,29 @@ class MouseTest < MiniTest::Unit::TestCase
     assert_kind_of CGPoint, Mouse.current_position
   end
 
+  def test_mouse_backend
+    assert_includes %w[coregraphics x11 uinput memory], Mouse.backend
+  end
+
+  def test_memory_backend_keeps_a_virtual_screen
+    skip 'only the memory backend has a virtual screen' unless Mouse.backend == 'memory'
+    Mouse::Memory.clear
+
+    Mouse.click_down [100, 200]
+    assert_equal [0], Mouse::Memory.buttons
+    Mouse.click_up
+    assert_empty Mouse::Memory.buttons
+
+    # the cursor stops at the edge of the screen, like a real one
+    Mouse.move_to [5000, -50], 0.05
+    width, height = Mouse::Memory.screen
+    assert_equal CGPoint.new(width - 1, 0), Mouse.current_position
+
+    types = Mouse::Memory.events.map(&:type)
+    assert_equal [1, 2], types.first(2) # left mouse down, then up
+    assert_equal 5, types.last          # mouse moved
+  end
+
   def test_mouse_move_to
     point = CGPoint.new(100, 100)
     Mouse.move_to point
@@ -27,11 +57,468 @@ class MouseTest < MiniTest::Unit::TestCase
     start_point = Mouse.current_position
 
     Mouse.move_to [10, 10], 1
-    assert_in_delta 1, (Time.now - start_time), 0.3
+    assert_in_delta 1, (Time.now - start_time), 0.1
 
     start_time = Time.now
     Mouse.move_to start_point, 0.1
     assert_in_delta 0.1, (Time.now - start_time), 0.05
   end
 
+  def test_mouse_move_to_by_dead_reckoning
+    Mouse.dead_reckoning = true
+    assert Mouse.dead_reckoning?
+
+    point = CGPoint.new(rand(700) + 150, rand(500) + 100)
+    Mouse.move_to point
+    assert_in_delta 0, distance(point, Mouse.current_position), 1.0
+
+    start_time = Time.now
+    Mouse.move_to [10, 10], 0.5
+    assert_in_delta 0.5, (Time.now - start_time), 0.05
+    assert_in_delta 0, distance(CGPoint.new(10, 10), Mouse.current_position), 1.0
+  ensure
+    Mouse.dead_reckoning = false
+  end
+
+  def test_time_warp
+    Mouse.time_warp = true
+    assert Mouse.time_warp?
+
+    Mouse.recorder.drain
+    Mouse.recorder.start
+    start_time = Time.now
+    Mouse.move_to [700, 500], 5, fps: 60
+    assert_operator (Time.now - start_time), :<, 1
+    Mouse.recorder.stop
+    assert_in_delta 0, distance(CGPoint.new(700, 500), Mouse.current_position), 1.0
+
+    # events are stamped as if they had been posted in real time
+    stamps = Mouse.recorder.drain.map(&:timestamp)
+    assert_in_delta 5, (stamps.last - stamps.first) / 1e9, 0.1
+  ensure
+    Mouse.recorder.stop
+    Mouse.time_warp = false
+  end
+
+  def test_devices_are_independent
+    left  = Mouse::Device.new(backend: 'memory', fps: 60, time_warp: true)
+    right = Mouse::Device.new(backend: 'memory', dead_reckoning: true, time_warp: true)
+    assert_equal 60, left.fps
+    assert right.dead_reckoning?
+    refute left.dead_reckoning?
+    assert_equal 'memory', right.backend
+
+    before = Mouse.current_position
+    [Thread.new { left.move_to [100, 100], 1 },
+     Thread.new { right.drag_to [500, 300], 1 }].each(&:join)
+
+    assert_in_delta 0, distance(CGPoint.new(100, 100), left.current_position), 1.0
+    assert_in_delta 0, distance(CGPoint.new(500, 300), right.current_position), 1.0
+    assert_equal before, Mouse.current_position
+    assert_equal 60, left.stats[:operations][:move_to][:frames_posted]
+    assert_equal 0,  left.stats[:operations][:drag_to][:count]
+
+    right.use do
+      assert_equal [1, 2], Mouse::Memory.events.map(&:type).values_at(0, -1)
+    end
+    assert_raises(ArgumentError) { Mouse::Device.new(backend: 'nowhere') }
+  end
+
+  def test_operations_from_many_threads_do_not_interleave
+    skip 'only the memory backend keeps its events' unless Mouse.backend == 'memory'
+    Mouse::Memory.clear
+
+    4.times.map { |i|
+      Thread.new {
+        3.times { |j|
+          Mouse.drag_to [100 + (i * 50), 100 + (j * 50)], 0.05
+          Mouse.move_to [50, 50], 0
+        }
+      }
+    }.each(&:join)
+
+    # moves, or a press followed by nothing but drags and then a release
+    types = Mouse::Memory.events.map(&:type).join(' ')
+    assert_match(/\A((5|1( 6)* 2)( |\z))+\z/, types)
+  end
+
+  def events_created_by
+    before = Mouse.event_counts
+    yield
+    after = Mouse.event_counts
+    [after[:created] - before[:created], after[:posted] - before[:posted]]
+  end
+
+  def test_animations_do_not_allocate_per_frame
+    # other backends post from the core's own event, see rake bench
+    skip 'only the coregraphics backend creates events' unless Mouse.backend == 'coregraphics'
+    Mouse.dead_reckoning = true
+
+    short_created, short_posted = events_created_by { Mouse.move_to [100, 100], 0.05 }
+    long_created,  long_posted  = events_created_by { Mouse.move_to [500, 500], 0.5 }
+    assert_operator long_posted, :>, short_posted
+    assert_equal short_created, long_created
+
+    short_created, short_posted = events_created_by { Mouse.scroll 5, :line, 0.05 }
+    long_created,  long_posted  = events_created_by { Mouse.scroll 5, :line, 0.5 }
+    assert_operator long_posted, :>, short_posted
+    assert_equal short_created, long_created
+  ensure
+    Mouse.dead_reckoning = false
+  end
+
+  def test_mouse_fps
+    assert_equal 240, Mouse.fps
+    Mouse.fps = 60
+    assert_equal 60, Mouse.fps
+    assert_raises(ArgumentError) { Mouse.fps = 0 }
+    assert_raises(ArgumentError) { Mouse.fps = 1001 }
+  ensure
+    Mouse.fps = 240
+  end
+
+  def test_animations_accept_fps_option
+    Mouse.dead_reckoning = true
+    Mouse.coalesce = false # every frame, even when the machine is busy
+
+    _, slow = events_created_by { Mouse.move_to [100, 100], 0.1, fps: 60 }
+    _, fast = events_created_by { Mouse.move_to [500, 500], 0.1, fps: 1000 }
+    assert_in_delta 6, slow, 1
+    assert_in_delta 100, fast, 1
+
+    assert_raises(ArgumentError) { Mouse.scroll 5, :line, 0.1, fps: -1 }
+    assert_raises(ArgumentError) { Mouse.scroll 5, :line, 0.1, frames: 1 }
+  ensure
+    Mouse.dead_reckoning = false
+    Mouse.coalesce = true
+  end
+
+  def test_animations_let_other_threads_run
+    ticks  = 0
+    ticker = Thread.new { loop { ticks += 1; sleep 0.01 } }
+    Mouse.move_to [300, 300], 0.5
+    ticker.kill
+    assert_operator ticks, :>, 20
+  end
+
+  def test_animations_can_be_interrupted
+    start_time = Time.now
+    assert_raises(Timeout::Error) do
+      Timeout.timeout(0.1) { Mouse.move_to [700, 700], 5 }
+    end
+    assert_in_delta 0.1, (Time.now - start_time), 0.05
+  end
+
+  def test_interrupts_pending_before_an_animation_stop_it
+    Mouse.move_to [100, 100], 0
+    thread = Thread.new do
+      Thread.handle_interrupt(RuntimeError => :never) do
+        sleep 0.01 until Thread.current[:go]
+        Thread.handle_interrupt(RuntimeError => :on_blocking) do
+          Mouse.move_to [700, 700], 1
+        end
+      end
+    end
+    thread.report_on_exception = false
+    sleep 0.05
+    thread.raise 'stop'
+    thread[:go] = true
+
+    start_time = Time.now
+    assert_raises(RuntimeError) { thread.join }
+    assert_operator Time.now - start_time, :<, 0.5
+    assert_operator distance(CGPoint.new(700, 700), Mouse.current_position), :>, 100
+  end
+
+  def test_async_operations_return_handles
+    handle = Mouse.move_to_async [200, 200], 0.3
+    refute handle.done?
+    assert_nil handle.position
+
+    position = handle.wait
+    assert handle.done?
+    refute handle.cancelled?
+    assert_in_delta 0, distance(CGPoint.new(200, 200), position), 1.0
+    assert_equal position, handle.position
+  end
+
+  def test_async_operations_can_be_cancelled
+    start_time = Time.now
+    running = Mouse.move_to_async [800, 600], 5
+    queued  = Mouse.click_async [800, 600]
+    queued.cancel
+    running.cancel
+
+    running.wait
+    queued.wait
+    assert running.cancelled?
+    assert queued.cancelled?
+    assert_in_delta 0, (Time.now - start_time), 0.1
+  end
+
+  def test_animations_time_out
+    Mouse.move_to [100, 100], 0
+    error = assert_raises(Mouse::TimeoutError) { Mouse.move_to [700, 100], 2, timeout: 0.2 }
+    assert_in_delta 0.1, error.progress, 0.05
+    assert_in_delta 160, error.position.x, 40
+    assert_raises(ArgumentError) { Mouse.move_to [100, 100], 0.1, timeout: 0 }
+    assert_raises(ArgumentError) { Mouse.move_to [100, 100], 0.1, timeout: Float::INFINITY }
+  end
+
+  def test_animations_too_long_to_plan
+    Mouse.move_to [100, 100], 0
+    assert_raises(Mouse::TimeoutError) { Mouse.move_to [500, 500], 2**60 / 1000.0, fps: 1000, timeout: 0.1 }
+    assert_raises(ArgumentError) { Mouse.move_to [100, 100], Float::INFINITY }
+    assert_raises(ArgumentError) { Mouse.scroll 5, :line, -1 }
+  end
+
+  def test_drags_release_the_button_when_cancelled
+    token = Mouse::Token.new
+    Thread.new { sleep 0.1; token.cancel }
+    error = assert_raises(Mouse::CancelledError) { Mouse.drag_to [600, 600], 2, cancel: token }
+    assert token.cancelled?
+    assert_operator error.progress, :<, 0.2
+    assert_kind_of Mouse::CancelledError, Mouse::TimeoutError.new
+  end
+
+  def test_async_operations_time_out
+    handle = Mouse.move_to_async [700, 700], 2, timeout: 0.1
+    handle.wait
+    assert handle.timed_out?
+    assert_operator handle.progress, :<, 0.1
+    assert_raises(ArgumentError) { Mouse.move_to_async [1, 1], cancel: Mouse::Token.new }
+  end
+
+  def test_batch
+    point = Mouse.batch do |b|
+      b.move_to([100, 100], 0.05).move_to CGPoint.new(300, 200), 0.05
+      b.scroll 0, :line, 0
+      assert_equal 3, b.length
+    end
+    assert_in_delta 0, distance(CGPoint.new(300, 200), point), 1.0
+    assert_raises(LocalJumpError) { Mouse.batch }
+    assert_raises(ArgumentError) { Mouse::Batch.new.move_to }
+  end
+
+  def test_batches_can_be_rerun
+    batch = Mouse::Batch.new.move_to([150, 150], 0.05).move_to([250, 250], 0.05)
+    Mouse.move_to [600, 600], 0
+    assert_in_delta 0, distance(CGPoint.new(250, 250), batch.run), 1.0
+    assert_in_delta 0, distance(CGPoint.new(250, 250), batch.run), 1.0
+    assert_equal 0, batch.clear.size
+  end
+
+  def test_batches_stop_at_a_timeout
+    batch = Mouse::Batch.new
+    batch.move_to [100, 100], 0.05
+    batch.move_to [700, 100], 2, timeout: 0.1
+    batch.move_to [700, 700], 0.05
+    assert_raises(Mouse::TimeoutError) { batch.run }
+    assert_operator Mouse.current_position.y, :<, 101
+  end
+
+  def test_follow_path
+    path   = (0..1000).flat_map { |i| [100 + (i * 0.5), 100 + (i * 0.2)] }.pack('d*')
+    start  = Time.now
+    point  = Mouse.follow_path path, 0.2
+    assert_in_delta 0.2, (Time.now - start), 0.05
+    assert_in_delta 0, distance(CGPoint.new(600, 300), point), 1.0
+
+    assert_in_delta 0, distance(CGPoint.new(5, 7), Mouse.follow_path([5, 7].pack('d*'), 0)), 1.0
+    assert_raises(ArgumentError) { Mouse.follow_path '', 0.1 }
+    assert_raises(ArgumentError) { Mouse.follow_path [1].pack('d*'), 0.1 }
+    assert_raises(TypeError)     { Mouse.follow_path [[1, 2]], 0.1 }
+  end
+
+  def test_click_all
+    points = (0...20).map { |i| [100 + (i * 10), 200] }
+    Mouse.recorder.drain
+    Mouse.recorder.start
+    start = Time.now
+    point = Mouse.click_all points.flatten.pack('d*'), hold: 0.005, interval: 0.005
+    Mouse.recorder.stop
+    assert_in_delta 0.195, (Time.now - start), 0.05
+    assert_in_delta 0, distance(CGPoint.new(290, 200), point), 1.0
+
+    events = Mouse.recorder.drain
+    assert_equal [1, 2] * 20, events.map(&:type) # left mouse down, then up
+    assert_equal points.map(&:first), events.map(&:x).each_slice(2).map(&:first)
+
+    Mouse.recorder.start
+    Mouse.click_all [300, 300].pack('d*'), button: :right, hold: 0
+    Mouse.recorder.stop
+    assert_equal [3, 4], Mouse.recorder.drain.map(&:type)
+
+    assert_raises(ArgumentError) { Mouse.click_all '', hold: 0 }
+    assert_raises(ArgumentError) { Mouse.click_all [1, 2].pack('d*'), hold: -1 }
+    assert_raises(ArgumentError) { Mouse.click_all [1, 2].pack('d*'), interval: Float::INFINITY }
+    assert_raises(ArgumentError) { Mouse.click_all [1, 2].pack('d*'), button: :fourth }
+    assert_raises(ArgumentError) { Mouse.click_all [1, 2].pack('d*'), duration: 1 }
+  end
+
+  TRACE_HEADER = ['MRMTRACE', 1, 64].pack('a8LL')
+
+  def trace_record timestamp, type, x, y
+    [timestamp, type, 0, 0, 0, x, y, 0, 0, 0, 0, 0, 0, 0.0, 0.0].pack('QS4d2l2S4d2')
+  end
+
+  def test_replay
+    file = Tempfile.new 'trace'
+    file.write TRACE_HEADER
+    (0..20).each { |i| file.write trace_record(1_000_000 + (i * 10_000_000), 5, 100 + (i * 10), 400) }
+    file.close
+
+    start = Time.now
+    point = Mouse.replay file.path
+    assert_in_delta 0.2, (Time.now - start), 0.05
+    assert_in_delta 0, distance(CGPoint.new(300, 400), point), 1.0
+
+    File.write file.path, 'not a trace at all'
+    assert_raises(ArgumentError) { Mouse.replay file.path }
+    assert_raises(Errno::ENOENT) { Mouse.replay '/does/not/exist' }
+  ensure
+    file.unlink
+  end
+
+  def test_recorder
+    Mouse.recorder.drain
+    Mouse.recorder.start
+    assert Mouse.recorder.recording?
+    Mouse.move_to [100, 100], 0.05
+    Mouse.scroll 3, :line, 0.05
+    Mouse.recorder.stop
+    Mouse.move_to [200, 200], 0.05
+
+    events = Mouse.recorder.drain
+    refute_empty events
+    assert_equal 100.0, events.select { |e| e.type == 5 }.last.x
+    assert_equal 3, events.select { |e| e.type == 22 }.map(&:scroll_vertical).reduce(:+)
+    assert_equal events.map(&:timestamp).sort, events.map(&:timestamp)
+    assert_empty Mouse.recorder.drain
+  end
+
+  def test_recorder_flushes_to_a_trace
+    file = Tempfile.new 'recording'
+    Mouse.recorder.flush_to file.path
+    Mouse.recorder.start
+    Mouse.move_to [100, 100], 0.05
+    Mouse.move_to [400, 300], 0.1
+    Mouse.recorder.stop
+    Mouse.recorder.stop_flushing
+
+    Mouse.move_to [700, 700], 0
+    assert_in_delta 0, distance(CGPoint.new(400, 300), Mouse.replay(file.path)), 1.0
+  ensure
+    file.unlink
+  end
+
+  def first_step_with profile
+    Mouse.move_to [100, 100], 0
+    Mouse.recorder.drain
+    Mouse.recorder.start
+    Mouse.move_to [500, 100], 0.1, profile: profile
+    Mouse.recorder.stop
+    moves = Mouse.recorder.drain.select { |e| e.type == 5 }
+    assert_in_delta 500, moves.last.x, 1.0
+    moves.first.x - 100
+  end
+
+  def test_motion_profiles
+    assert_equal :linear, Mouse.profile
+    linear = first_step_with :linear
+    [:ease_in_out, :minimum_jerk, :s_curve].each do |profile|
+      assert_operator first_step_with(profile), :<, linear / 2
+    end
+
+    Mouse.profile = :minimum_jerk
+    assert_equal :minimum_jerk, Mouse.profile
+    assert_raises(ArgumentError) { Mouse.profile = :bouncy }
+    assert_raises(ArgumentError) { Mouse.move_to [1, 1], profile: :bouncy }
+  ensure
+    Mouse.profile = :linear
+  end
+
+  def test_plan
+    Mouse.move_to [100, 100], 0
+    plan = Mouse.plan :move_to, [317, 200], 0.2, fps: 100
+    assert_equal 20, plan[:frames].size
+    assert_in_delta 0.2, plan[:duration], 0.001
+    assert_in_delta 0, distance(CGPoint.new(317, 200), plan[:frames].last), 0.001
+    assert_in_delta 0, distance(CGPoint.new(100, 100), Mouse.current_position), 1.0
+    assert Mouse.plan(:move_to, [317, 200], 0.2, fps: 100)[:cached]
+
+    assert_empty Mouse.plan(:click)[:frames]
+    assert_operator Mouse.plan(:click)[:duration], :>, 0
+    assert_raises(ArgumentError) { Mouse.plan :current_position }
+  end
+
+  def test_stats
+    Mouse.move_to [100, 100], 0
+    Mouse.reset_stats
+    Mouse.move_to [300, 100], 0.1, fps: 100
+    Mouse.click
+
+    stats = Mouse.stats
+    move  = stats[:operations][:move_to]
+    assert_equal 1, move[:count]
+    assert_equal 10, move[:frames_planned]
+    assert_equal 10, move[:frames_posted] + move[:frames_coalesced]
+    assert_in_delta 0.1, move[:p50], 0.02
+    assert_operator move[:max], :>=, move[:p50]
+    assert_equal 1, move[:histogram].map(&:last).inject(:+)
+
+    # a click is not also counted as a click down and a click up
+    assert_equal 1, stats[:operations][:click][:count]
+    assert_equal 0, stats[:operations][:click_down][:count]
+    assert_operator stats[:lateness][:count], :>=, 10
+
+    Mouse.reset_stats
+    assert_equal 0, Mouse.stats[:operations][:move_to][:count]
+    assert_equal 0, Mouse.stats[:lateness][:count]
+  end
+
+  # the animation is stopped half way through, as if the machine was too
+  # busy to run it, and has to catch up once it carries on
+  def late_move coalesce
+    reader, writer = IO.pipe
+    pid = fork do
+      reader.close
+      Mouse.coalesce = coalesce
+      Mouse.dead_reckoning = true
+      Mouse.move_to [100, 100], 0
+      Mouse.reset_stats
+      start = Process.clock_gettime Process::CLOCK_MONOTONIC
+      Mouse.move_to [300, 100], 1, fps: 50
+      took = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+      move = Mouse.stats[:operations][:move_to]
+      writer.puts [took, move[:frames_posted], move[:frames_coalesced]].join(' ')
+      writer.puts Mouse.current_position.x
+      exit!
+    end
+    writer.close
+    sleep 0.3
+    Process.kill :STOP, pid
+    sleep 0.4
+    Process.kill :CONT, pid
+    took, posted, coalesced = reader.gets.split.map(&:to_f)
+    x = reader.gets.to_f
+    Process.wait pid
+    [took, posted.to_i, coalesced.to_i, x]
+  ensure
+    reader.close unless reader.closed?
+  end
+
+  def test_late_moves_are_coalesced
+    took, posted, coalesced, x = late_move true
+    assert_operator coalesced, :>=, 10
+    assert_equal 50, posted + coalesced
+    assert_in_delta 1, took, 0.2
+    assert_in_delta 300, x, 1
+
+    took, posted, coalesced, x = late_move false
+    assert_equal 0, coalesced
+    assert_equal 50, posted
+    assert_in_delta 300, x, 1
+  end
+
 end